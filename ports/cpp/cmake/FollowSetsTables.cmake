@@ -0,0 +1,55 @@
+set(ANTLR4C3_CMAKE_DIR ${CMAKE_CURRENT_LIST_DIR})
+
+# Generates the follow sets of a grammar at build time (see
+# c3::writeFollowSetsTables) and adds them to a target, where they are
+# available as c3::tables::<NAME> from the header <NAME>.hpp.
+#
+# antlr4c3_generate_follow_sets(
+#     TARGET <target to add the tables to>
+#     NAME <name of the tables variable>
+#     PARSER <generated parser class, declared in <PARSER>.h>
+#     SOURCES <generated parser sources>
+#     [INCLUDE_DIRECTORIES <directories of the generated parser headers>]
+#     [PREFERRED_RULES <rule names>]
+# )
+function(antlr4c3_generate_follow_sets)
+    cmake_parse_arguments(
+        ARG
+        ""
+        "TARGET;NAME;PARSER"
+        "SOURCES;INCLUDE_DIRECTORIES;PREFERRED_RULES"
+        ${ARGN}
+    )
+
+    set(ANTLR4C3_TABLES_DIR ${CMAKE_BINARY_DIR}/follow-sets/${ARG_NAME})
+    set(ANTLR4C3_GENERATOR ${PROJECT_NAME}-follow-sets-${ARG_NAME})
+    set(ANTLR4C3_GENERATOR_PARSER ${ARG_PARSER})
+
+    configure_file(
+        ${ANTLR4C3_CMAKE_DIR}/FollowSetsGenerator.cpp.in
+        ${ANTLR4C3_TABLES_DIR}/generator/main.cpp
+        @ONLY
+    )
+
+    add_executable(
+        ${ANTLR4C3_GENERATOR}
+        ${ANTLR4C3_TABLES_DIR}/generator/main.cpp
+        ${ARG_SOURCES}
+    )
+    target_include_directories(${ANTLR4C3_GENERATOR} PRIVATE ${ARG_INCLUDE_DIRECTORIES})
+    target_link_libraries(${ANTLR4C3_GENERATOR} PRIVATE ${PROJECT_NAME})
+
+    add_custom_command(
+        OUTPUT
+        ${ANTLR4C3_TABLES_DIR}/${ARG_NAME}.hpp
+        ${ANTLR4C3_TABLES_DIR}/${ARG_NAME}.cpp
+        COMMAND
+        ${ANTLR4C3_GENERATOR} ${ARG_NAME} ${ANTLR4C3_TABLES_DIR} ${ARG_PREFERRED_RULES}
+        DEPENDS ${ANTLR4C3_GENERATOR}
+        COMMENT "Generating follow sets tables ${ARG_NAME}"
+        VERBATIM
+    )
+
+    target_sources(${ARG_TARGET} PRIVATE ${ANTLR4C3_TABLES_DIR}/${ARG_NAME}.cpp)
+    target_include_directories(${ARG_TARGET} PRIVATE ${ANTLR4C3_TABLES_DIR})
+endfunction()
@@ -9,8 +9,14 @@ macro(define_grammar_test grammar)
         ${CMAKE_CURRENT_LIST_DIR}/../../../..
     )
 
+    # Grammars with target specific actions are kept next to their tests.
+    set(ANTLR4C3_GRAMMAR ${ANTLR4C3_TS_PROJECT_ROOT}/tests/${grammar})
+    if(EXISTS ${CMAKE_CURRENT_LIST_DIR}/${grammar})
+        set(ANTLR4C3_GRAMMAR ${CMAKE_CURRENT_LIST_DIR}/${grammar})
+    endif()
+
     configure_file(
-        ${ANTLR4C3_TS_PROJECT_ROOT}/tests/${grammar}
+        ${ANTLR4C3_GRAMMAR}
         ${CMAKE_CURRENT_BINARY_DIR}/${grammar}
         COPYONLY
     )
@@ -23,6 +29,7 @@ macro(define_grammar_test grammar)
     file(
         GLOB_RECURSE SOURCE CONFIGURE_DEPENDS 
         *.hpp *.cpp
+        ${CMAKE_CURRENT_LIST_DIR}/../utility/*.cpp
         ${CMAKE_CURRENT_BINARY_DIR}/*.hpp
         ${CMAKE_CURRENT_BINARY_DIR}/*.cpp
     )
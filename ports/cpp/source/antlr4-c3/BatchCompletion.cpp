@@ -0,0 +1,150 @@
+//
+//  BatchCompletion.cpp
+//
+//  C++ port of antlr4-c3 (TypeScript) by Mike Lischke
+//  Licensed under the MIT License.
+//
+
+#include "BatchCompletion.hpp"
+
+#include "CodeCompletionCore.hpp"
+#include "GrammarModel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace c3 {
+
+namespace {
+
+void accumulate(Statistics& totals, Statistics const& request) {
+  totals.statesProcessed += request.statesProcessed;
+  totals.ruleInvocations += request.ruleInvocations;
+  totals.shortcutHits += request.shortcutHits;
+  totals.followSetsLookups += request.followSetsLookups;
+  totals.followSetsComputed += request.followSetsComputed;
+  totals.followSetsStates += request.followSetsStates;
+  totals.statesPruned += request.statesPruned;
+  totals.predicateEvaluations += request.predicateEvaluations;
+  totals.statesMerged += request.statesMerged;
+  totals.rulesSkipped += request.rulesSkipped;
+  totals.tokensSimulated += request.tokensSimulated;
+}
+
+}  // namespace
+
+double BatchStatistics::requestsPerSecond() const {
+  const std::chrono::duration<double> seconds = elapsed;
+  return seconds.count() > 0 ? static_cast<double>(requests) / seconds.count() : 0.0;
+}
+
+BatchCompletion::BatchCompletion(std::shared_ptr<const GrammarModel> model, size_t threads)
+    : model(std::move(model)) {
+  if (threads == 0) {
+    threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  }
+
+  contexts.reserve(threads);
+  for (size_t i = 0; i < threads; ++i) {
+    contexts.push_back(std::make_unique<CodeCompletionCore>(this->model));
+  }
+}
+
+BatchResult BatchCompletion::run(std::span<const CompletionRequest> requests) {
+  const auto start = std::chrono::steady_clock::now();
+
+  // Checkpoints are updated by the request using them, so requests running
+  // concurrently must not share them.
+  std::vector<const Checkpoints*> checkpoints;
+  for (const CompletionRequest& request : requests) {
+    if (request.parameters.checkpoints != nullptr) {
+      checkpoints.push_back(request.parameters.checkpoints);
+    }
+  }
+  std::ranges::sort(checkpoints);
+  if (std::ranges::adjacent_find(checkpoints) != checkpoints.end()) {
+    throw std::invalid_argument(
+        "BatchCompletion::run: several requests share a Checkpoints object"
+    );
+  }
+
+  BatchResult result;
+  result.results.resize(requests.size());
+
+  // No more workers than requests, the remaining contexts stay idle.
+  const size_t workerCount = std::min(contexts.size(), requests.size());
+  std::vector<Statistics> workerTotals(workerCount);
+  std::vector<size_t> workerCancelled(workerCount, 0);
+  std::vector<std::exception_ptr> errors(requests.size());
+
+  // Workers take the next unprocessed request until none is left, so a few
+  // expensive requests do not hold up a statically assigned share.
+  std::atomic<size_t> next = 0;
+  const auto work = [&](size_t worker) {
+    CodeCompletionCore& completion = *contexts[worker];
+    for (size_t index = next++; index < requests.size(); index = next++) {
+      const CompletionRequest& request = requests[index];
+      CandidatesCollection& candidates = result.results[index];
+      try {
+        if (request.tokenStream != nullptr) {
+          candidates = completion.collectCandidates(
+              *request.tokenStream, request.caretTokenIndex, request.parameters
+          );
+        } else {
+          candidates = completion.collectCandidates(request.tokenTypes, request.parameters);
+        }
+      } catch (...) {
+        // An exception leaving a worker thread would terminate the process.
+        // Other requests go on, the error is raised once all are done.
+        errors[index] = std::current_exception();
+        continue;
+      }
+
+      accumulate(workerTotals[worker], completion.statistics());
+      if (candidates.isCancelled) {
+        ++workerCancelled[worker];
+      }
+    }
+  };
+
+  {
+    std::vector<std::jthread> workers;
+    workers.reserve(workerCount);
+    for (size_t worker = 1; worker < workerCount; ++worker) {
+      workers.emplace_back(work, worker);
+    }
+
+    // The calling thread is a worker, too.
+    if (workerCount > 0) {
+      work(0);
+    }
+  }
+
+  for (const std::exception_ptr& error : errors) {
+    if (error != nullptr) {
+      std::rethrow_exception(error);
+    }
+  }
+
+  BatchStatistics& statistics = result.statistics;
+  statistics.requests = requests.size();
+  statistics.threads = workerCount;
+  for (size_t worker = 0; worker < workerCount; ++worker) {
+    accumulate(statistics.totals, workerTotals[worker]);
+    statistics.cancelled += workerCancelled[worker];
+  }
+  statistics.elapsed = std::chrono::steady_clock::now() - start;
+
+  return result;
+}
+
+}  // namespace c3
@@ -0,0 +1,113 @@
+//
+//  BatchCompletion.hpp
+//
+//  C++ port of antlr4-c3 (TypeScript) by Mike Lischke
+//  Licensed under the MIT License.
+//
+
+#pragma once
+
+#include "CodeCompletionCore.hpp"
+#include "GrammarModel.hpp"
+
+#include <TokenStream.h>
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <vector>
+
+namespace c3 {
+
+/**
+ * One independent completion request of a batch. The input is either a
+ * token stream with a caret token index or, if no stream is given, a
+ * sequence of token types.
+ */
+struct CompletionRequest {
+  /**
+   * The input, if it comes from a token stream. The stream must be filled
+   * before the batch runs. Several requests may share a stream.
+   */
+  antlr4::TokenStream* tokenStream = nullptr;
+
+  /** The index of the token at the caret, if `tokenStream` is set. */
+  size_t caretTokenIndex = 0;
+
+  /** The token types before the caret, if `tokenStream` is not set. */
+  std::vector<size_t> tokenTypes = {};
+
+  Parameters parameters = {};
+};
+
+/**
+ * Aggregate counters of a batch run.
+ */
+struct BatchStatistics {
+  size_t requests = 0;
+
+  /** Number of requests which were cancelled or timed out. */
+  size_t cancelled = 0;
+
+  /** The work counters of all requests, summed up. */
+  Statistics totals = {};
+
+  /** Wall clock time of the whole batch. */
+  std::chrono::nanoseconds elapsed = {};
+
+  /** Number of worker threads used. */
+  size_t threads = 0;
+
+  /** @returns The number of requests completed per second. */
+  [[nodiscard]] double requestsPerSecond() const;
+};
+
+struct BatchResult {
+  /** The candidates of each request, in request order. */
+  std::vector<CandidatesCollection> results;
+
+  BatchStatistics statistics;
+};
+
+/**
+ * Runs many independent completion requests for one grammar on a set of
+ * worker threads.
+ *
+ * Each worker owns one `CodeCompletionCore` context, which it reuses for all
+ * its requests and across batches, so the per-request containers keep their
+ * capacity. All workers share the follow sets cache of the model. Contexts
+ * are created without a parser: semantic predicates are answered by the
+ * model's predicate evaluator, or assumed to hold. The tailoring fields come
+ * from the model's options.
+ *
+ * A `BatchCompletion` instance runs one batch at a time. Requests of a batch
+ * run concurrently, so each needs its own `Parameters::checkpoints`, if any.
+ */
+class BatchCompletion {
+public:
+  /**
+   * @param model The grammar of all requests.
+   * @param threads The number of worker threads. 0 selects the number of
+   * hardware threads.
+   */
+  explicit BatchCompletion(std::shared_ptr<const GrammarModel> model, size_t threads = 0);
+
+  /**
+   * Collects the candidates for all given requests.
+   *
+   * @param requests The requests to run.
+   * @returns The results in request order, with aggregate statistics.
+   * @throws std::invalid_argument If several requests share a `Checkpoints`
+   * object. No request is run then.
+   * @throws The first exception, in request order, thrown by a request. It is
+   * rethrown on the calling thread once all other requests are done.
+   */
+  BatchResult run(std::span<const CompletionRequest> requests);
+
+private:
+  std::shared_ptr<const GrammarModel> model;
+  std::vector<std::unique_ptr<CodeCompletionCore>> contexts;
+};
+
+}  // namespace c3
@@ -0,0 +1,149 @@
+//
+//  Checkpoints.cpp
+//
+//  C++ port of antlr4-c3 (TypeScript) by Mike Lischke
+//  Licensed under the MIT License.
+//
+
+#include "Checkpoints.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+namespace c3 {
+
+Checkpoints::Checkpoints(CheckpointOptions options) : settings(std::move(options)) {
+}
+
+void Checkpoints::invalidate(size_t tokenIndex) {
+  const auto firstDropped =
+      std::ranges::upper_bound(checkpoints, tokenIndex, {}, &Checkpoint::tokenIndex);
+  checkpoints.erase(firstDropped, checkpoints.end());
+
+  if (checkpoints.empty()) {
+    frames.clear();
+    configurations.clear();
+  } else {
+    const Checkpoint& last = checkpoints.back();
+    frames.resize(last.frameCount);
+    configurations.resize(last.configurationOffset + last.configurationCount);
+  }
+
+  if (stoppedAt.has_value() && *stoppedAt > tokenIndex) {
+    stoppedAt.reset();
+  }
+}
+
+void Checkpoints::clear() {
+  atn = nullptr;
+  predicates.clear();
+  frames.clear();
+  configurations.clear();
+  checkpoints.clear();
+  stoppedAt.reset();
+}
+
+size_t Checkpoints::size() const {
+  return checkpoints.size();
+}
+
+std::vector<size_t> Checkpoints::tokenIndexes() const {
+  std::vector<size_t> result;
+  result.reserve(checkpoints.size());
+  for (const Checkpoint& checkpoint : checkpoints) {
+    result.push_back(checkpoint.tokenIndex);
+  }
+  return result;
+}
+
+size_t Checkpoints::bytes() const {
+  return sizeof(*this) + settings.syncTokens.bytes() + frames.capacity() * sizeof(Frame) +
+         configurations.capacity() * sizeof(Configuration) +
+         checkpoints.capacity() * sizeof(Checkpoint) +
+         predicates.capacity() * sizeof(std::pair<size_t, bool>);
+}
+
+const CheckpointOptions& Checkpoints::options() const {
+  return settings;
+}
+
+size_t Checkpoints::FrameHash::operator()(const Frame& frame) const noexcept {
+  size_t seed = 0;
+  for (const size_t value :
+       {frame.parent,
+        frame.returnState,
+        frame.ruleIndex,
+        frame.startTokenIndex,
+        static_cast<size_t>(frame.precedence)}) {
+    seed ^= std::hash<size_t>{}(value) + 0x9e3779b97f4a7c15ULL + (seed << 6) +  // NOLINT: magic
+            (seed >> 2);
+  }
+  return seed;
+}
+
+const Checkpoints::Checkpoint* Checkpoints::before(size_t tokenIndex) const {
+  const auto iter = std::ranges::lower_bound(checkpoints, tokenIndex, {}, &Checkpoint::tokenIndex);
+  return iter == checkpoints.begin() ? nullptr : &*std::prev(iter);
+}
+
+/**
+ * Stores the given configurations as a checkpoint. They must have been
+ * compacted before, so that all frames in use belong to them.
+ *
+ * @param tokenIndex The index of the next token to match.
+ * @param current The configurations.
+ */
+void Checkpoints::record(size_t tokenIndex, std::vector<Configuration> const& current) {
+  checkpoints.push_back({
+      .tokenIndex = tokenIndex,
+      .configurationOffset = configurations.size(),
+      .configurationCount = current.size(),
+      .frameCount = frames.size(),
+  });
+  configurations.insert(configurations.end(), current.begin(), current.end());
+}
+
+/**
+ * Removes the frames after the last checkpoint which the given configurations
+ * do not use (any longer) and renumbers the others.
+ *
+ * @param current The configurations after the last checkpoint.
+ */
+void Checkpoints::compact(std::vector<Configuration>& current) {
+  const size_t first = checkpoints.empty() ? 0 : checkpoints.back().frameCount;
+
+  std::vector<size_t> renumbered(frames.size() - first, NoFrame);
+  for (const Configuration& configuration : current) {
+    for (size_t frame = configuration.frame;
+         frame != NoFrame && frame >= first && renumbered[frame - first] == NoFrame;
+         frame = frames[frame].parent) {
+      renumbered[frame - first] = 0;
+    }
+  }
+
+  // Parents come first, so they are always renumbered before their children.
+  const auto renumber = [&](size_t frame) {
+    return (frame == NoFrame || frame < first) ? frame : renumbered[frame - first];
+  };
+
+  size_t next = first;
+  for (size_t frame = first; frame < frames.size(); ++frame) {
+    if (renumbered[frame - first] != NoFrame) {
+      renumbered[frame - first] = next;
+      frames[next] = frames[frame];
+      frames[next].parent = renumber(frames[next].parent);
+      ++next;
+    }
+  }
+  frames.resize(next);
+
+  for (Configuration& configuration : current) {
+    configuration.frame = renumber(configuration.frame);
+  }
+}
+
+}  // namespace c3
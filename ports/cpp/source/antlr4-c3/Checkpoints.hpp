@@ -0,0 +1,163 @@
+//
+//  Checkpoints.hpp
+//
+//  C++ port of antlr4-c3 (TypeScript) by Mike Lischke
+//  Licensed under the MIT License.
+//
+
+#pragma once
+
+#include "IndexSet.hpp"
+
+#include <atn/ATN.h>
+
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace c3 {
+
+/**
+ * When `Checkpoints` records a checkpoint.
+ */
+struct CheckpointOptions {
+  /** Record a checkpoint at least every this many tokens (hidden ones included). */
+  size_t interval = 1024;  // NOLINT: magic
+
+  /** Token types (e.g. `;`) after which a checkpoint is recorded, too. */
+  IndexSet syncTokens = {};
+
+  /**
+   * The maximum number of configurations in a checkpoint. Input which is
+   * that ambiguous is not simulated further, and completion walks from the
+   * last checkpoint before it.
+   */
+  size_t maxConfigurations = 4096;  // NOLINT: magic
+};
+
+/**
+ * Snapshots of the ATN simulation of one input (e.g. an open document), from
+ * which `CodeCompletionCore` continues instead of walking the input from its
+ * first token (see `Parameters::checkpoints`).
+ *
+ * A checkpoint holds all ways to match the input before one token: for each,
+ * the ATN state ready to match the token and the stack of rules invoked to
+ * get there. Stacks share their common bottom frames. Checkpoints are
+ * recorded while collecting candidates, up to the caret, and only depend on
+ * the tokens before them. Once the input changes, `invalidate` must be called
+ * with the index of the first changed token. Checkpoints are only valid for
+ * one grammar and the outcomes of the semantic predicates consulted while
+ * recording them. They are cleared and recorded afresh when used with
+ * another grammar or when one of these predicates evaluates differently.
+ *
+ * Not thread-safe: use one instance per input and request at a time.
+ */
+class Checkpoints {
+public:
+  explicit Checkpoints(CheckpointOptions options = {});
+
+  /**
+   * Drops the checkpoints which depend on the given token or any following
+   * one. Token indexes after an edit usually shift, so all later checkpoints
+   * are dropped, too.
+   *
+   * @param tokenIndex The index of the first changed token in the token
+   * stream (including hidden tokens).
+   */
+  void invalidate(size_t tokenIndex);
+
+  /** Drops all checkpoints. */
+  void clear();
+
+  /** @returns The number of checkpoints. */
+  [[nodiscard]] size_t size() const;
+
+  /** @returns The token indexes before which checkpoints were recorded, ascending. */
+  [[nodiscard]] std::vector<size_t> tokenIndexes() const;
+
+  /** @returns The approximate number of bytes held. */
+  [[nodiscard]] size_t bytes() const;
+
+  [[nodiscard]] const CheckpointOptions& options() const;
+
+private:
+  friend class CodeCompletionCore;
+
+  static constexpr size_t NoFrame = std::numeric_limits<size_t>::max();
+
+  /**
+   * A rule invocation on a stack. The start rule has no parent and no return
+   * state.
+   */
+  struct Frame {
+    size_t parent = NoFrame;
+
+    /** The state number at which the calling rule continues. */
+    size_t returnState = 0;
+
+    size_t ruleIndex = 0;
+    size_t startTokenIndex = 0;
+    int precedence = 0;
+
+    friend bool operator==(const Frame& lhs, const Frame& rhs) = default;
+  };
+
+  struct FrameHash {
+    size_t operator()(const Frame& frame) const noexcept;
+  };
+
+  /** A state ready to match the next token, within the rule of its frame. */
+  struct Configuration {
+    size_t state = 0;
+    size_t frame = NoFrame;
+  };
+
+  struct Checkpoint {
+    /** The index of the next token to match. */
+    size_t tokenIndex = 0;
+
+    size_t configurationOffset = 0;
+    size_t configurationCount = 0;
+
+    /** The number of frames used by this and all previous checkpoints. */
+    size_t frameCount = 0;
+  };
+
+  CheckpointOptions settings;
+
+  /** The grammar the checkpoints were recorded for. */
+  const antlr4::atn::ATN* atn = nullptr;
+
+  /**
+   * The semantic predicates (by slot) consulted while recording, with their
+   * outcomes.
+   */
+  std::vector<std::pair<size_t, bool>> predicates;
+
+  /**
+   * Frames of all checkpoints. Parents always come before their children.
+   * While recording, frames of the configurations after the last checkpoint
+   * follow.
+   */
+  std::vector<Frame> frames;
+
+  std::vector<Configuration> configurations;
+  std::vector<Checkpoint> checkpoints;
+
+  /** The token index before which the simulation ended, if it did. */
+  std::optional<size_t> stoppedAt;
+
+  /**
+   * @param tokenIndex The token index of the caret.
+   * @returns The last checkpoint before the caret, if any.
+   */
+  [[nodiscard]] const Checkpoint* before(size_t tokenIndex) const;
+
+  void record(size_t tokenIndex, std::vector<Configuration> const& current);
+
+  void compact(std::vector<Configuration>& current);
+};
+
+}  // namespace c3
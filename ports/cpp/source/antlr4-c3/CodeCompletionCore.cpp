@@ -7,6 +7,12 @@
 
 #include "CodeCompletionCore.hpp"
 
+#include "Checkpoints.hpp"
+#include "GrammarAnalysis.hpp"
+#include "GrammarModel.hpp"
+#include "Metrics.hpp"
+#include "VocabularyTrie.hpp"
+
 #include <Parser.h>
 #include <ParserRuleContext.h>
 #include <Token.h>
@@ -21,19 +27,30 @@
 #include <atn/RuleTransition.h>
 #include <atn/Transition.h>
 #include <atn/TransitionType.h>
+#include <tree/ErrorNode.h>
+#include <tree/ParseTree.h>
 
 #include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <cmath>
 #include <cstddef>
+#include <functional>
 #include <iostream>
 #include <iterator>
+#include <map>
+#include <memory>
+#include <optional>
 #include <ranges>
 #include <set>
+#include <span>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -41,25 +58,27 @@ namespace c3 {
 
 namespace {
 
-std::vector<size_t> longestCommonPrefix(
-    std::vector<size_t> const& lhs, std::vector<size_t> const& rhs
-) {
-  size_t index = 0;
-  for (; index < std::min(lhs.size(), rhs.size()); index++) {
-    if (lhs[index] != rhs[index]) {
-      break;
-    }
-  }
-  return {
-      lhs.begin(),
-      std::next(lhs.begin(), static_cast<std::ptrdiff_t>(index)),
-  };
+/**
+ * Shortens the given token list to the longest prefix it has in common with
+ * the other one.
+ */
+void truncateToCommonPrefix(std::vector<size_t>& tokens, std::span<const size_t> other) {
+  const auto mismatch = std::ranges::mismatch(tokens, other);
+  tokens.erase(mismatch.in1, tokens.end());
 }
 
-}  // namespace
+// Rough per-node bookkeeping costs of the standard containers, used for the
+// memory estimates. Hash nodes carry a next pointer and the cached hash, tree
+// nodes three links and the color.
+constexpr size_t HashNodeOverhead = 2 * sizeof(void*);
+constexpr size_t TreeNodeOverhead = 4 * sizeof(void*);
 
-thread_local std::unordered_map<std::type_index, CodeCompletionCore::FollowSetsPerState>  // NOLINT
-    CodeCompletionCore::followSetsByATN = {};
+template <class T>
+size_t vectorBytes(std::vector<T> const& vector) {
+  return vector.capacity() * sizeof(T);
+}
+
+}  // namespace
 
 // Matches ATNStateType enum
 std::vector<std::string> CodeCompletionCore::atnStateTypeMap  // NOLINT
@@ -80,10 +99,34 @@ std::vector<std::string> CodeCompletionCore::atnStateTypeMap  // NOLINT
     };
 
 CodeCompletionCore::CodeCompletionCore(antlr4::Parser* parser)
-    : parser(parser)
-    , atn(&parser->getATN())
-    , vocabulary(&parser->getVocabulary())
-    , ruleNames(&parser->getRuleNames())
+    : CodeCompletionCore(GrammarModel::forParser(*parser), parser) {
+}
+
+CodeCompletionCore::CodeCompletionCore(
+    const antlr4::atn::ATN& atn,
+    const antlr4::dfa::Vocabulary& vocabulary,
+    std::vector<std::string> const& ruleNames,
+    std::string const& grammarName,
+    PredicateEvaluator predicateEvaluator
+)
+    : CodeCompletionCore(GrammarModel::forATN(atn, vocabulary, ruleNames, grammarName)) {
+  this->predicateEvaluator = std::move(predicateEvaluator);
+}
+
+CodeCompletionCore::CodeCompletionCore(
+    std::shared_ptr<const GrammarModel> model, antlr4::Parser* parser
+)
+    : ignoredTokens(model->options().ignoredTokens)
+    , preferredRules(model->options().preferredRules)
+    , translateRulesTopDown(model->options().translateRulesTopDown)
+    , predicateEvaluator(model->options().predicateEvaluator)
+    , model(std::move(model))
+    , parser(parser)
+    , atn(&this->model->atn())
+    , vocabulary(&this->model->vocabulary())
+    , ruleNames(&this->model->ruleNames())
+    , analysis(&this->model->analysis())
+    , shortcutMap(this->model->atn().ruleToStartState.size())
     , timeout(0)
     , cancel(nullptr) {
 }
@@ -91,28 +134,108 @@ CodeCompletionCore::CodeCompletionCore(antlr4::Parser* parser)
 CandidatesCollection CodeCompletionCore::collectCandidates(
     size_t caretTokenIndex, Parameters parameters
 ) {
-  const auto* context = parameters.context;
+  return collectCandidates(parserTokenStream("collectCandidates"), caretTokenIndex, parameters);
+}
 
-  timeout = parameters.timeout;
-  cancel = parameters.isCancelled;
-  timeoutStart = std::chrono::steady_clock::now();
+CandidatesCollection CodeCompletionCore::collectCandidates(
+    antlr4::TokenStream& tokenStream, size_t caretTokenIndex, Parameters parameters
+) {
+  readTokens(tokenStream, caretTokenIndex, parameters);
+  return collect(parameters);
+}
 
-  shortcutMap.clear();
-  candidates.rules.clear();
-  candidates.tokens.clear();
-  candidates.isCancelled = false;
-  statesProcessed = 0;
-  precedenceStack = {};
+CandidatesCollection CodeCompletionCore::collectCandidates(
+    std::span<const size_t> tokenTypes, Parameters parameters
+) {
+  readTokens(tokenTypes);
+  return collect(parameters);
+}
+
+bool CodeCompletionCore::isViablePrefix(size_t caretTokenIndex, Parameters parameters) {
+  return isViablePrefix(parserTokenStream("isViablePrefix"), caretTokenIndex, parameters);
+}
+
+bool CodeCompletionCore::isViablePrefix(
+    antlr4::TokenStream& tokenStream, size_t caretTokenIndex, Parameters parameters
+) {
+  readTokens(tokenStream, caretTokenIndex, parameters);
+  return checkViability(parameters);
+}
+
+bool CodeCompletionCore::isViablePrefix(
+    std::span<const size_t> tokenTypes, Parameters parameters
+) {
+  readTokens(tokenTypes);
+  return checkViability(parameters);
+}
+
+size_t CodeCompletionCore::furthestViableToken() const {
+  return tokens.empty() ? 0 : tokens[std::min(furthestPosition, tokens.size() - 1)].tokenIndex;
+}
+
+/**
+ * @param caller The name of the public member which needs the token stream.
+ * @returns The token stream of the parser.
+ * @throws std::logic_error If the engine was created without a parser.
+ */
+antlr4::TokenStream& CodeCompletionCore::parserTokenStream(const char* caller) const {
+  if (parser == nullptr) {
+    throw std::logic_error(
+        std::string("CodeCompletionCore::") + caller +
+        ": the engine has no parser, pass the token stream explicitly"
+    );
+  }
+  return *parser->getTokenStream();
+}
+
+/**
+ * Resets the work counters and the predicate outcomes for a new request, and
+ * takes the outcomes the predicate evaluator provides.
+ */
+void CodeCompletionCore::startRequest() {
+  stats = {};
+  predicateTrace = nullptr;
+  predicateOutcomes.assign(analysis->predicates().size(), std::nullopt);
+  if (predicateEvaluator) {
+    const std::vector<bool> outcomes = predicateEvaluator(analysis->predicates());
+    for (size_t slot = 0; slot < std::min(outcomes.size(), predicateOutcomes.size()); ++slot) {
+      predicateOutcomes[slot] = outcomes[slot];
+    }
+  }
+}
 
-  tokenStartIndex = (context != nullptr) ? context->start->getTokenIndex() : 0;
-  auto* const tokenStream = parser->getTokenStream();
+/**
+ * Fills the token list with the default channel tokens from the start (or
+ * the given context or checkpoint) up to the first one on or after the caret.
+ *
+ * @param tokenStream The (filled) token stream.
+ * @param caretTokenIndex The index of the token at the caret position.
+ * @param parameters The parameters of the request.
+ */
+void CodeCompletionCore::readTokens(
+    antlr4::TokenStream& tokenStream, size_t caretTokenIndex, Parameters const& parameters
+) {
+  startRequest();
 
-  tokens = {};
+  const auto* context = parameters.context;
+
+  tokenStartIndex = 0;
+  if (context != nullptr) {
+    tokenStartIndex = context->start->getTokenIndex();
+  } else if (parameters.checkpoints != nullptr && checkpointsMatch(*parameters.checkpoints)) {
+    // Only the input from the checkpoint to continue from is needed.
+    const auto* checkpoint = parameters.checkpoints->before(caretTokenIndex);
+    if (checkpoint != nullptr) {
+      tokenStartIndex = checkpoint->tokenIndex;
+    }
+  }
+
+  tokens.clear();
   size_t offset = tokenStartIndex;
   while (true) {
-    const antlr4::Token* token = tokenStream->get(offset++);
+    const antlr4::Token* token = tokenStream.get(offset++);
     if (token->getChannel() == antlr4::Token::DEFAULT_CHANNEL) {
-      tokens.push_back(token);
+      tokens.push_back({.type = token->getType(), .tokenIndex = token->getTokenIndex()});
 
       if (token->getTokenIndex() >= caretTokenIndex) {
         break;
@@ -125,11 +248,133 @@ CandidatesCollection CodeCompletionCore::collectCandidates(
       break;
     }
   }
+}
+
+/**
+ * Fills the token list with the given token types, followed by the caret entry.
+ *
+ * @param tokenTypes The token types before the caret.
+ */
+void CodeCompletionCore::readTokens(std::span<const size_t> tokenTypes) {
+  startRequest();
+
+  tokenStartIndex = 0;
+
+  tokens.clear();
+  tokens.reserve(tokenTypes.size() + 1);
+  for (const size_t type : tokenTypes) {
+    tokens.push_back({.type = type, .tokenIndex = tokens.size()});
+  }
+
+  // The caret entry. Its type is never looked at.
+  tokens.push_back({.type = antlr4::Token::EOF, .tokenIndex = tokens.size()});
+}
+
+/**
+ * Runs the ATN walk over the prepared token list without collecting
+ * candidates, until the first path reaches the caret.
+ *
+ * @param parameters The parameters passed to `isViablePrefix`.
+ * @returns true if a path reached the caret.
+ */
+bool CodeCompletionCore::checkViability(Parameters const& parameters) {
+  viabilityOnly = true;
+  collect(parameters);
+  viabilityOnly = false;
+
+  return reachedCaret;
+}
+
+/**
+ * Runs the ATN walk over the prepared token list and collects the candidates
+ * for its last entry.
+ *
+ * @param parameters The parameters passed to `collectCandidates`.
+ * @returns The collected candidates.
+ */
+CandidatesCollection CodeCompletionCore::collect(Parameters const& parameters) {
+  const auto* context = parameters.context;
+
+  timeout = parameters.timeout;
+  cancel = parameters.isCancelled;
+  order = parameters.order;
+  maxStates = parameters.maxStates;
+  timeoutStart = std::chrono::steady_clock::now();
+
+  for (PositionMap& positionMap : shortcutMap) {
+    positionMap.clear();
+  }
+  candidates.rules.clear();
+  candidates.tokens.clear();
+  candidates.ruleOccurrences.clear();
+  candidates.rulePaths.clear();
+  rulePathsByHash.clear();
+  occurrencesByHash.clear();
+  collectRulePaths = parameters.collectRulePaths;
+
+  prefixTokens.reset();
+  prefixIntervals = {};
+  if (!parameters.prefix.empty()) {
+    prefixTokens = model->vocabularyTrie().matching(parameters.prefix);
+    for (const size_t token : *prefixTokens) {
+      prefixIntervals.add(static_cast<ptrdiff_t>(token));
+    }
+  }
+  candidates.isCancelled = false;
+  precedenceStack.clear();
+  reachedCaret = false;
+  furthestPosition = 0;
+
+  parsedRules.clear();
+  if (parameters.parseTree != nullptr) {
+    indexParseTree(parameters.parseTree);
+  }
 
   RuleWithStartTokenList callStack = {};
   const size_t startRule = (context != nullptr) ? context->getRuleIndex() : 0;
 
-  processRule(atn->ruleToStartState[startRule], 0, callStack, 0, 0, candidates.isCancelled);
+  const Checkpoints::Checkpoint* checkpoint = nullptr;
+  if (parameters.checkpoints != nullptr && context == nullptr) {
+    extendCheckpoints(*parameters.checkpoints);
+    checkpoint = parameters.checkpoints->before(tokens.back().tokenIndex);
+  }
+
+  const auto byTokenIndex = [](const InputToken& token) { return token.tokenIndex; };
+  auto resumeAt = tokens.end();
+  if (checkpoint != nullptr) {
+    resumeAt = std::ranges::lower_bound(tokens, checkpoint->tokenIndex, {}, byTokenIndex);
+  }
+  if (resumeAt != tokens.end() && resumeAt->tokenIndex == checkpoint->tokenIndex) {
+    resumeWalk(
+        *parameters.checkpoints,
+        *checkpoint,
+        static_cast<size_t>(resumeAt - tokens.begin()),
+        candidates.isCancelled
+    );
+  } else {
+    processRule(atn->ruleToStartState[startRule], 0, callStack, 0, 0, candidates.isCancelled);
+  }
+
+  // A viability check ends the walk as soon as it reaches the caret.
+  if (viabilityOnly && reachedCaret) {
+    candidates.isCancelled = false;
+  }
+
+  // Viability checks are not completion requests, so they must not skew the
+  // request metrics.
+  if (!viabilityOnly && MetricsRegistry::instance().isEnabled()) {
+    const bool cancelled = cancel != nullptr && cancel->load();
+    model->metrics().record({
+        .latency = std::chrono::steady_clock::now() - timeoutStart,
+        .statistics = stats,
+        .timedOut = candidates.isCancelled && !cancelled,
+        .cancelled = candidates.isCancelled && cancelled,
+    });
+  }
+
+  if (viabilityOnly) {
+    return {};
+  }
 
   for (auto& [_, following] : candidates.tokens) {
     auto removed = std::ranges::remove_if(following, [&](size_t token) {
@@ -143,15 +388,237 @@ CandidatesCollection CodeCompletionCore::collectCandidates(
   return candidates;
 }
 
+void CodeCompletionCore::buildFollowSets(size_t threads) {
+  if (threads == 0) {
+    threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  }
+
+  startRequest();
+  for (size_t slot = 0; slot < predicateOutcomes.size(); ++slot) {
+    checkPredicate(slot);
+  }
+
+  // The other workers get the predicate outcomes instead of a parser, so only
+  // this thread ever uses the parser.
+  std::vector<std::unique_ptr<CodeCompletionCore>> helpers;
+  for (size_t i = 1; i < threads; ++i) {
+    auto helper = std::make_unique<CodeCompletionCore>(model);
+    helper->debugOptions = debugOptions;
+    helper->predicateOutcomes = predicateOutcomes;
+    helpers.push_back(std::move(helper));
+  }
+
+  for (const std::vector<size_t>& level : analysis->ruleLevels()) {
+    std::atomic<size_t> next = 0;
+    const auto work = [&](CodeCompletionCore& worker) {
+      for (size_t index = next++; index < level.size(); index = next++) {
+        worker.ruleFollowSets(atn->ruleToStartState[level[index]]);
+      }
+    };
+
+    std::vector<std::jthread> workers;
+    for (size_t i = 0; i + 1 < std::min(threads, level.size()); ++i) {
+      workers.emplace_back(work, std::ref(*helpers[i]));
+    }
+    work(*this);
+  }
+
+  for (const auto& helper : helpers) {
+    stats.followSetsLookups += helper->stats.followSetsLookups;
+    stats.followSetsComputed += helper->stats.followSetsComputed;
+    stats.followSetsStates += helper->stats.followSetsStates;
+  }
+}
+
+bool CodeCompletionCore::loadFollowSets(const FollowSetsTables& tables) {
+  if (tables.stateCount != atn->states.size() || tables.ruleCount != atn->ruleToStartState.size() ||
+      (!tables.grammarName.empty() && !model->grammarName().empty() &&
+       tables.grammarName != model->grammarName())) {
+    return false;
+  }
+
+  for (const RuleFollowSetsRecord& rule : tables.rules) {
+    FollowSetsHolder holder = {
+        .sets = {},
+        .combined = {},
+        .isExhaustive = rule.isExhaustive,
+        .predicates = {},
+    };
+
+    for (const FollowSetRecord& record : tables.sets.subspan(rule.setOffset, rule.setCount)) {
+      FollowSetWithPath set;
+      const auto bounds =
+          tables.intervals.subspan(2 * record.intervalOffset, 2 * record.intervalCount);
+      for (size_t i = 0; i < bounds.size(); i += 2) {
+        set.intervals.add(bounds[i], bounds[i + 1]);
+      }
+      const auto path = tables.paths.subspan(record.pathOffset, record.pathLength);
+      set.path.assign(path.begin(), path.end());
+      const auto following =
+          tables.following.subspan(record.followingOffset, record.followingLength);
+      set.following.assign(following.begin(), following.end());
+
+      holder.combined.addAll(set.intervals);
+      holder.sets.push_back(std::move(set));
+    }
+
+    for (const PredicateRecord& predicate :
+         tables.predicates.subspan(rule.predicateOffset, rule.predicateCount)) {
+      holder.predicates.emplace_back(predicate.slot, predicate.outcome);
+    }
+
+    model->followSets().insert(
+        rule.stateNumber, std::move(holder), model->options().followSetsCacheLimit
+    );
+  }
+
+  if (!tables.preferredRules.empty()) {
+    preferredRules = IndexSet(tables.preferredRules);
+  }
+
+  return true;
+}
+
+MemoryUsage CodeCompletionCore::memoryUsage() const {
+  MemoryUsage usage;
+
+  const FollowSetsCache& followSets = model->followSets();
+  usage.followSetsBytes = followSets.bytes();
+  usage.followSetsEntries = followSets.size();
+  usage.followSetsEvictions = followSets.evictions();
+
+  usage.memoBytes = memoBytes();
+
+  return usage;
+}
+
+const Statistics& CodeCompletionCore::statistics() const {
+  return stats;
+}
+
+const GrammarModel& CodeCompletionCore::grammarModel() const {
+  return *model;
+}
+
+size_t CodeCompletionCore::MemoKeyHash::operator()(const MemoKey& key) const noexcept {
+  return std::hash<size_t>{}(key.tokenListIndex) ^
+         (std::hash<int>{}(key.precedence) * 0x9e3779b97f4a7c15ULL);  // NOLINT: magic
+}
+
+/**
+ * @returns true if the state budget of the current call is used up.
+ */
+bool CodeCompletionCore::isOverBudget() const {
+  return maxStates.has_value() && stats.statesProcessed >= *maxStates;
+}
+
+/**
+ * Records the end positions of the error free subtrees of a parse tree which
+ * can be skipped by the walk (see `Parameters::parseTree`).
+ *
+ * @param context The root of the (sub)tree.
+ * @returns true if the tree contains no syntax errors.
+ */
+bool CodeCompletionCore::indexParseTree(const antlr4::ParserRuleContext* context) {
+  bool isClean =
+      context->exception == nullptr && context->start != nullptr && context->stop != nullptr;
+  for (const antlr4::tree::ParseTree* child : context->children) {
+    if (const auto* childContext = dynamic_cast<const antlr4::ParserRuleContext*>(child)) {
+      // Index all children, even after an error was found.
+      isClean = indexParseTree(childContext) && isClean;
+    } else if (dynamic_cast<const antlr4::tree::ErrorNode*>(child) != nullptr) {
+      isClean = false;
+    }
+  }
+
+  if (!isClean) {
+    return false;
+  }
+
+  // Walks of left-recursive rules depend on the precedence they start with.
+  const size_t ruleIndex = context->getRuleIndex();
+  if (atn->ruleToStartState[ruleIndex]->isLeftRecursiveRule) {
+    return true;
+  }
+
+  const auto byTokenIndex = [](const InputToken& token) { return token.tokenIndex; };
+  const size_t startIndex = context->start->getTokenIndex();
+
+  // The stop token precedes the start token for rules which matched nothing.
+  const size_t endIndex = std::max(startIndex, context->stop->getTokenIndex() + 1);
+
+  const auto start = std::ranges::lower_bound(tokens, startIndex, {}, byTokenIndex);
+  const auto end = std::ranges::lower_bound(tokens, endIndex, {}, byTokenIndex);
+
+  // The parser decided where the rule ends by looking at the next token, which
+  // must therefore be one of the input and not the one at the caret.
+  if (start == tokens.end() || start->tokenIndex != startIndex ||
+      end >= std::prev(tokens.end())) {
+    return true;
+  }
+
+  const auto key = parsedRuleKey(ruleIndex, static_cast<size_t>(start - tokens.begin()));
+  parsedRules[key].insert(static_cast<size_t>(end - tokens.begin()));
+
+  return true;
+}
+
+/**
+ * @returns The key of a rule walk in `parsedRules`.
+ */
+size_t CodeCompletionCore::parsedRuleKey(size_t ruleIndex, size_t tokenListIndex) const {
+  return tokenListIndex * atn->ruleToStartState.size() + ruleIndex;
+}
+
 /**
  * Checks if the predicate associated with the given transition evaluates to
- * true.
+ * true. Outcomes are kept for the rest of the `collectCandidates` call.
  *
  * @param transition The transition to check.
  * @returns the evaluation result of the predicate.
  */
 bool CodeCompletionCore::checkPredicate(const antlr4::atn::PredicateTransition* transition) {
-  return transition->getPredicate()->eval(parser, &antlr4::ParserRuleContext::EMPTY);
+  const std::optional<size_t> slot =
+      analysis->predicateSlot(transition->getRuleIndex(), transition->getPredIndex());
+  if (!slot.has_value()) {
+    if (parser == nullptr) {
+      return true;
+    }
+    ++stats.predicateEvaluations;
+    return transition->getPredicate()->eval(parser, &antlr4::ParserRuleContext::EMPTY);
+  }
+
+  return checkPredicate(*slot);
+}
+
+/**
+ * Evaluates the predicate in the given slot, unless that was done before in
+ * the current call. While determining follow sets, also records the outcome as
+ * a dependency of the sets.
+ *
+ * @param slot The position of the predicate in the grammar analysis.
+ * @returns the evaluation result of the predicate.
+ */
+bool CodeCompletionCore::checkPredicate(size_t slot) {
+  std::optional<bool>& outcome = predicateOutcomes[slot];
+  if (!outcome.has_value() && parser == nullptr) {
+    // Without a parser nothing can evaluate the predicate. Assume it holds,
+    // like the grammar analysis does.
+    outcome = true;
+  } else if (!outcome.has_value()) {
+    ++stats.predicateEvaluations;
+    outcome = analysis->predicateTransition(slot)->getPredicate()->eval(
+        parser, &antlr4::ParserRuleContext::EMPTY
+    );
+  }
+
+  if (predicateTrace != nullptr &&
+      std::ranges::find(*predicateTrace, slot, &std::pair<size_t, bool>::first) ==
+          predicateTrace->end()) {
+    predicateTrace->emplace_back(slot, *outcome);
+  }
+
+  return *outcome;
 }
 
 /**
@@ -204,91 +671,104 @@ bool CodeCompletionCore::translateToRuleIndex(
 ) {
   const auto& rwst = ruleWithStartTokenList[index];
 
-  if (preferredRules.contains(rwst.ruleIndex)) {
-    // Add the rule to our candidates list along with the current rule path,
-    // but only if there isn't already an entry like that.
+  if (!preferredRules.contains(rwst.ruleIndex)) {
+    return false;
+  }
+
+  if (collectRulePaths) {
+    addRuleOccurrence(index, ruleWithStartTokenList);
+  }
+
+  // Add the rule to our candidates list along with the current rule path,
+  // but only if there isn't already an entry with the same path.
+  const auto existing = candidates.rules.find(rwst.ruleIndex);
+  const bool addNew = existing == candidates.rules.end() ||
+                      !std::ranges::equal(
+                          ruleWithStartTokenList | std::views::take(index) |
+                              std::views::transform(&RuleWithStartToken::ruleIndex),
+                          existing->second.ruleList
+                      );
+
+  if (addNew) {
     std::vector<size_t> path;
     path.reserve(index);
     for (size_t i = 0; i < index; i++) {
       path.push_back(ruleWithStartTokenList[i].ruleIndex);
     }
 
-    bool addNew = true;
-    for (auto const& [cRuleEntryRuleIndex, cRuleEntryCandidateRule] : candidates.rules) {
-      if (cRuleEntryRuleIndex != rwst.ruleIndex ||
-          cRuleEntryCandidateRule.ruleList.size() != path.size()) {
-        continue;
-      }
-
-      // Found an entry for this rule. Same path?
-      bool samePath = true;
-      for (size_t i = 0; i < path.size(); i++) {
-        if (path[i] == cRuleEntryCandidateRule.ruleList[i]) {
-          samePath = false;
-          break;
-        }
-      }
-
-      // If same path, then don't add a new (duplicate) entry.
-      if (samePath) {
-        addNew = false;
-        break;
-      }
-    }
-
-    if (addNew) {
-      candidates.rules[rwst.ruleIndex] = {
-          .startTokenIndex = rwst.startTokenIndex,
-          .ruleList = path,
-      };
-      if (debugOptions.showDebugOutput) {
-        std::cout << "=====> collected:  " << ruleNames->at(rwst.ruleIndex) << "\n";
-      }
+    candidates.rules[rwst.ruleIndex] = {
+        .startTokenIndex = rwst.startTokenIndex,
+        .ruleList = std::move(path),
+    };
+    if (debugOptions.showDebugOutput) {
+      std::cout << "=====> collected:  " << ruleNames->at(rwst.ruleIndex) << "\n";
     }
-
-    return true;
   }
 
-  return false;
+  return true;
 }
 
 /**
- * This method follows the given transition and collects all symbols within the
- * same rule that directly follow it without intermediate transitions to other
- * rules and only if there is a single symbol for a transition.
+ * Records the preferred rule at the given index of a rule chain with its call
+ * path, unless it was found with the same start token and path before. Paths
+ * are interned in `candidates.rulePaths`.
  *
- * @param transition The transition from which to start.
- * @returns A list of toke types.
+ * @param index The position of the preferred rule in the chain.
+ * @param ruleWithStartTokenList The rule chain.
  */
-std::vector<size_t> CodeCompletionCore::getFollowingTokens(const antlr4::atn::Transition* transition
+void CodeCompletionCore::addRuleOccurrence(
+    size_t index, RuleWithStartTokenList const& ruleWithStartTokenList
 ) {
-  std::vector<size_t> result;
-  std::vector<antlr4::atn::ATNState*> pipeline = {transition->target};
+  const auto mix = [](size_t seed, size_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));  // NOLINT: magic
+  };
 
-  while (!pipeline.empty()) {
-    antlr4::atn::ATNState* state = pipeline.back();
-    pipeline.pop_back();
+  const auto path = ruleWithStartTokenList | std::views::take(index) |
+                    std::views::transform(&RuleWithStartToken::ruleIndex);
 
-    if (state == nullptr) {
-      continue;
+  size_t pathHash = index;
+  for (const size_t rule : path) {
+    pathHash = mix(pathHash, rule);
+  }
+
+  // Intern the path.
+  std::optional<size_t> pathOffset;
+  const auto [first, last] = rulePathsByHash.equal_range(pathHash);
+  for (auto iter = first; iter != last; ++iter) {
+    const auto [offset, length] = iter->second;
+    if (length == index && std::ranges::equal(path, candidates.path({0, offset, length}))) {
+      pathOffset = offset;
+      break;
     }
+  }
 
-    for (const antlr4::atn::ConstTransitionPtr& outgoing : state->transitions) {
-      if (outgoing->getTransitionType() == antlr4::atn::TransitionType::ATOM) {
-        if (!outgoing->isEpsilon()) {
-          const auto list = outgoing->label();
-          if (list.size() == 1) {
-            result.push_back(list.get(0));
-            pipeline.push_back(outgoing->target);
-          }
-        } else {
-          pipeline.push_back(outgoing->target);
-        }
-      }
+  if (!pathOffset.has_value()) {
+    pathOffset = candidates.rulePaths.size();
+    candidates.rulePaths.insert(candidates.rulePaths.end(), path.begin(), path.end());
+    rulePathsByHash.emplace(pathHash, std::pair(*pathOffset, index));
+  }
+
+  const RuleOccurrence occurrence = {
+      .startTokenIndex = ruleWithStartTokenList[index].startTokenIndex,
+      .pathOffset = *pathOffset,
+      .pathLength = index,
+  };
+  const size_t ruleIndex = ruleWithStartTokenList[index].ruleIndex;
+
+  // Deduplicate the occurrence.
+  const size_t occurrenceHash =
+      mix(mix(mix(ruleIndex, occurrence.startTokenIndex), *pathOffset), index);
+  std::vector<RuleOccurrence>& occurrences = candidates.ruleOccurrences[ruleIndex];
+  const auto [begin, end] = occurrencesByHash.equal_range(occurrenceHash);
+  for (auto iter = begin; iter != end; ++iter) {
+    const auto [rule, position] = iter->second;
+    if (rule == ruleIndex && occurrences[position] == occurrence) {
+      return;
     }
   }
 
-  return result;
+  occurrencesByHash.emplace(occurrenceHash, std::pair(ruleIndex, occurrences.size()));
+  occurrences.push_back(occurrence);
 }
 
 /**
@@ -298,13 +778,18 @@ std::vector<size_t> CodeCompletionCore::getFollowingTokens(const antlr4::atn::Tr
  * @param stop Stop state.
  * @returns Follow sets.
  */
-CodeCompletionCore::FollowSetsHolder CodeCompletionCore::determineFollowSets(
+FollowSetsHolder CodeCompletionCore::determineFollowSets(
     antlr4::atn::ATNState* start, antlr4::atn::ATNState* stop
 ) {
   std::vector<FollowSetWithPath> sets = {};
   std::vector<antlr4::atn::ATNState*> stateStack = {};
   std::vector<size_t> ruleStack = {};
+  std::vector<std::pair<size_t, bool>> predicates = {};
+
+  std::vector<std::pair<size_t, bool>>* const previousTrace =
+      std::exchange(predicateTrace, &predicates);
   const bool isExhaustive = collectFollowSets(start, stop, sets, stateStack, ruleStack);
+  predicateTrace = previousTrace;
 
   // Sets are split by path to allow translating them to preferred rules. But
   // for quick hit tests it is also useful to have a set with all symbols
@@ -318,9 +803,56 @@ CodeCompletionCore::FollowSetsHolder CodeCompletionCore::determineFollowSets(
       .sets = sets,
       .combined = combined,
       .isExhaustive = isExhaustive,
+      .predicates = predicates,
   };
 }
 
+/**
+ * Returns the follow sets of the given rule for the current predicate
+ * outcomes, from the cache or determined now. While determining the follow
+ * sets of another rule, the predicates the returned sets depend on become
+ * dependencies of those sets, too.
+ *
+ * @param startState The start state of the rule.
+ * @returns The follow sets of the rule.
+ */
+std::shared_ptr<const FollowSetsHolder> CodeCompletionCore::ruleFollowSets(
+    antlr4::atn::RuleStartState* startState
+) {
+  FollowSetsCache& cache = model->followSets();
+  ++stats.followSetsLookups;
+
+  // Predicates checked to pick a variant are no dependencies by themselves.
+  std::vector<std::pair<size_t, bool>>* const trace = std::exchange(predicateTrace, nullptr);
+
+  std::shared_ptr<const FollowSetsHolder> holder =
+      cache.find(startState->stateNumber, [&](const FollowSetsHolder& candidate) {
+        return std::ranges::all_of(candidate.predicates, [&](const auto& dependency) {
+          return checkPredicate(dependency.first) == dependency.second;
+        });
+      });
+  if (holder == nullptr) {
+    ++stats.followSetsComputed;
+    antlr4::atn::RuleStopState* stop = atn->ruleToStopState[startState->ruleIndex];
+    holder = cache.insert(
+        startState->stateNumber,
+        determineFollowSets(startState, stop),
+        model->options().followSetsCacheLimit
+    );
+  }
+
+  predicateTrace = trace;
+  if (predicateTrace != nullptr) {
+    for (const auto& dependency : holder->predicates) {
+      if (std::ranges::find(*predicateTrace, dependency) == predicateTrace->end()) {
+        predicateTrace->push_back(dependency);
+      }
+    }
+  }
+
+  return holder;
+}
+
 /**
  * Collects possible tokens which could be matched following the given ATN
  * state. This is essentially the same algorithm as used in the LL1Analyzer
@@ -341,6 +873,8 @@ bool CodeCompletionCore::collectFollowSets(  // NOLINT
     std::vector<antlr4::atn::ATNState*>& stateStack,
     std::vector<size_t>& ruleStack
 ) {
+  ++stats.followSetsStates;
+
   if (std::ranges::find(stateStack, state) != stateStack.end()) {
     return true;
   }
@@ -358,14 +892,36 @@ bool CodeCompletionCore::collectFollowSets(  // NOLINT
     if (transition->getTransitionType() == antlr4::atn::TransitionType::RULE) {
       const auto* ruleTransition = dynamic_cast<const antlr4::atn::RuleTransition*>(transition);
 
-      if (std::ranges::find(ruleStack, ruleTransition->target->ruleIndex) != ruleStack.end()) {
+      const size_t ruleIndex = ruleTransition->target->ruleIndex;
+      if (std::ranges::find(ruleStack, ruleIndex) != ruleStack.end()) {
         continue;
       }
 
-      ruleStack.push_back(ruleTransition->target->ruleIndex);
-      const bool ruleFollowSetsIsExhaustive =
-          collectFollowSets(transition->target, stopState, followSets, stateStack, ruleStack);
-      ruleStack.pop_back();
+      bool ruleFollowSetsIsExhaustive = false;
+      if (debugOptions.disableFollowSetsSplicing || analysis->isRecursive(ruleIndex)) {
+        ruleStack.push_back(ruleIndex);
+        ruleFollowSetsIsExhaustive =
+            collectFollowSets(transition->target, stopState, followSets, stateStack, ruleStack);
+        ruleStack.pop_back();
+      } else {
+        // A rule which cannot invoke itself can neither reach the rules and
+        // states on the current stacks, so it is walked the same way wherever
+        // it is invoked. Take its own follow sets, with our call path
+        // prepended, instead of descending into it again.
+        const std::shared_ptr<const FollowSetsHolder> ruleSets =
+            ruleFollowSets(dynamic_cast<antlr4::atn::RuleStartState*>(transition->target));
+        for (const FollowSetWithPath& set : ruleSets->sets) {
+          RuleList path = ruleStack;
+          path.push_back(ruleIndex);
+          path.insert(path.end(), set.path.begin(), set.path.end());
+          followSets.push_back({
+              .intervals = set.intervals,
+              .path = std::move(path),
+              .following = set.following,
+          });
+        }
+        ruleFollowSetsIsExhaustive = ruleSets->isExhaustive;
+      }
 
       // If the subrule had an epsilon transition to the rule end, the tokens
       // added to the follow set are non-exhaustive and we should continue
@@ -399,10 +955,12 @@ bool CodeCompletionCore::collectFollowSets(  // NOLINT
         if (transition->getTransitionType() == antlr4::atn::TransitionType::NOT_SET) {
           label = label.complement(allUserTokens());
         }
+        const std::span<const size_t> following =
+            analysis->followingTokens(transition->target->stateNumber);
         followSets.push_back({
             .intervals = label,
             .path = ruleStack,
-            .following = getFollowingTokens(transition),
+            .following = {following.begin(), following.end()},
         });
       }
     }
@@ -448,15 +1006,41 @@ CodeCompletionCore::RuleEndStatus CodeCompletionCore::processRule(  // NOLINT
     return {};
   }
 
+  furthestPosition = std::max(furthestPosition, tokenListIndex);
+  if (viabilityOnly && tokenListIndex >= tokens.size() - 1) {
+    // The input before the caret is viable, nothing is collected.
+    reachedCaret = true;
+    timedOut = true;
+    return {};
+  }
+
   // Start with rule specific handling before going into the ATN walk.
 
+  // The parser matched this rule here before, and the walk can continue
+  // behind its subtree.
+  if (!parsedRules.empty()) {
+    const auto iter = parsedRules.find(parsedRuleKey(startState->ruleIndex, tokenListIndex));
+    if (iter != parsedRules.end()) {
+      ++stats.rulesSkipped;
+      furthestPosition = std::max(furthestPosition, std::ranges::max(iter->second));
+      return iter->second;
+    }
+  }
+
+  ++stats.ruleInvocations;
+
   // Check first if we've taken this path with the same input before.
-  std::unordered_map<size_t, RuleEndStatus>& positionMap = shortcutMap[startState->ruleIndex];
-  if (positionMap.contains(tokenListIndex)) {
+  const MemoKey memoKey = {
+      .tokenListIndex = tokenListIndex,
+      .precedence = startState->isLeftRecursiveRule ? precedence : 0,
+  };
+  auto& positionMap = shortcutMap[startState->ruleIndex];
+  if (const auto iter = positionMap.find(memoKey); iter != positionMap.end()) {
+    ++stats.shortcutHits;
     if (debugOptions.showDebugOutput) {
       std::cout << "=====> shortcut" << "\n";
     }
-    return positionMap[tokenListIndex];
+    return iter->second;
   }
 
   RuleEndStatus result;
@@ -470,18 +1054,14 @@ CodeCompletionCore::RuleEndStatus CodeCompletionCore::processRule(  // NOLINT
   // further visit of the same rule, which often happens
   //    in non trivial grammars, especially with (recursive) expressions and of
   //    course when invoking code completion multiple times.
-  FollowSetsPerState& setsPerState = followSetsByATN[typeid(parser)];
-
-  if (!setsPerState.contains(startState->stateNumber)) {
-    antlr4::atn::RuleStopState* stop = atn->ruleToStopState[startState->ruleIndex];
-    setsPerState[startState->stateNumber] = determineFollowSets(startState, stop);
-  }
+  std::shared_ptr<const FollowSetsHolder> cachedFollowSets = ruleFollowSets(startState);
 
-  const FollowSetsHolder& followSets = setsPerState[startState->stateNumber];
+  // Keep our own reference, as nested rules may evict the cache entry.
+  const FollowSetsHolder& followSets = *cachedFollowSets;
 
   // Get the token index where our rule starts from our (possibly filtered)
   // token list
-  const size_t startTokenIndex = tokens[tokenListIndex]->getTokenIndex();
+  const size_t startTokenIndex = tokens[tokenListIndex].tokenIndex;
 
   callStack.push_back({
       .startTokenIndex = startTokenIndex,
@@ -509,7 +1089,7 @@ CodeCompletionCore::RuleEndStatus CodeCompletionCore::processRule(  // NOLINT
         }
 
         if (!translateStackToRuleIndex(fullPath)) {
-          for (const size_t symbol : set.intervals.toList()) {
+          for (const size_t symbol : candidateTokens(set.intervals).toList()) {
             if (!ignoredTokens.contains(symbol)) {
               if (debugOptions.showDebugOutput) {
                 std::cout << "=====> collected:  " << vocabulary->getDisplayName(symbol) << "\n";
@@ -543,7 +1123,7 @@ CodeCompletionCore::RuleEndStatus CodeCompletionCore::processRule(  // NOLINT
   // Process the rule if we either could pass it without consuming anything
   // (epsilon transition) or if the current input symbol will be matched
   // somewhere after this entry point. Otherwise stop here.
-  const size_t currentSymbol = tokens[tokenListIndex]->getType();
+  const size_t currentSymbol = tokens[tokenListIndex].type;
   if (followSets.isExhaustive && !followSets.combined.contains(currentSymbol)) {
     callStack.pop_back();
 
@@ -554,25 +1134,396 @@ CodeCompletionCore::RuleEndStatus CodeCompletionCore::processRule(  // NOLINT
     precedenceStack.push_back(precedence);
   }
 
+  const PipelineEntry entry = {.state = startState, .tokenListIndex = tokenListIndex};
+  result = walkRule(startState, std::span(&entry, 1), callStack, indentation, timedOut);
+  if (timedOut) {
+    return {};
+  }
+
+  callStack.pop_back();
+  if (startState->isLeftRecursiveRule) {
+    precedenceStack.pop_back();
+  }
+
+  // Cache the result, for later lookup to avoid duplicate walks.
+  positionMap[memoKey] = result;
+
+  return result;
+}
+
+/**
+ * Checks if checkpoints can be resumed: they must be recorded for this
+ * grammar, and the predicates consulted while recording them must evaluate
+ * the same way now.
+ *
+ * @param checkpoints The checkpoints of the input.
+ * @returns true if the checkpoints are valid for this request.
+ */
+bool CodeCompletionCore::checkpointsMatch(const Checkpoints& checkpoints) {
+  return checkpoints.atn == atn &&
+         std::ranges::all_of(checkpoints.predicates, [&](const auto& dependency) {
+           return checkPredicate(dependency.first) == dependency.second;
+         });
+}
+
+/**
+ * Simulates the input from the last checkpoint on up to the token before the
+ * caret and records checkpoints on the way (see `Parameters::checkpoints`).
+ *
+ * @param checkpoints The checkpoints of the input.
+ */
+void CodeCompletionCore::extendCheckpoints(Checkpoints& checkpoints) {
+  using Configuration = Checkpoints::Configuration;
+
+  if (!checkpointsMatch(checkpoints)) {
+    checkpoints.clear();
+    checkpoints.atn = atn;
+  }
+
+  std::vector<Configuration> current;
+  std::vector<Configuration> pending;
+  size_t position = 0;
+  if (checkpoints.checkpoints.empty()) {
+    // The first checkpoint is the start of the input.
+    if (tokenStartIndex != 0) {
+      return;
+    }
+
+    checkpoints.frames.push_back({
+        .parent = Checkpoints::NoFrame,
+        .returnState = 0,
+        .ruleIndex = 0,
+        .startTokenIndex = tokens[0].tokenIndex,
+        .precedence = 0,
+    });
+    pending.push_back({.state = atn->ruleToStartState[0]->stateNumber, .frame = 0});
+    current = closure(checkpoints, pending, tokens[0].tokenIndex);
+    checkpoints.compact(current);
+    checkpoints.record(tokens[0].tokenIndex, current);
+  } else {
+    const Checkpoints::Checkpoint& last = checkpoints.checkpoints.back();
+    const auto byTokenIndex = [](const InputToken& token) { return token.tokenIndex; };
+    const auto iter = std::ranges::lower_bound(tokens, last.tokenIndex, {}, byTokenIndex);
+    if (iter == tokens.end() || iter->tokenIndex != last.tokenIndex) {
+      // The caret precedes the last checkpoint.
+      return;
+    }
+
+    position = static_cast<size_t>(iter - tokens.begin());
+    const auto configurations = std::span(checkpoints.configurations)
+                                    .subspan(last.configurationOffset, last.configurationCount);
+    current.assign(configurations.begin(), configurations.end());
+  }
+
+  if (checkpoints.stoppedAt.has_value()) {
+    return;
+  }
+
+  const CheckpointOptions& options = checkpoints.settings;
+  size_t lastTokenIndex = tokens[position].tokenIndex;
+
+  // Checkpoints are recorded up to the one before the token at the caret.
+  for (; position + 2 < tokens.size(); ++position) {
+    if (cancel != nullptr && cancel->load()) {
+      break;
+    }
+
+    const size_t symbol = tokens[position].type;
+    for (const Configuration& configuration : current) {
+      for (const antlr4::atn::ConstTransitionPtr& transition :
+           atn->states[configuration.state]->transitions) {
+        if (!transition->isEpsilon() &&
+            transition->matches(symbol, antlr4::Token::MIN_USER_TOKEN_TYPE, atn->maxTokenType)) {
+          pending.push_back({
+              .state = transition->target->stateNumber,
+              .frame = configuration.frame,
+          });
+        }
+      }
+    }
+    ++stats.tokensSimulated;
+
+    const size_t tokenIndex = tokens[position + 1].tokenIndex;
+    current = closure(checkpoints, pending, tokenIndex);
+    checkpoints.compact(current);
+
+    if (current.empty() || current.size() > options.maxConfigurations) {
+      // A syntax error, or input too ambiguous to keep track of.
+      checkpoints.stoppedAt = tokenIndex;
+      break;
+    }
+
+    if (options.syncTokens.contains(symbol) || tokenIndex - lastTokenIndex >= options.interval) {
+      checkpoints.record(tokenIndex, current);
+      lastTokenIndex = tokenIndex;
+    }
+  }
+
+  // Drop the frames used after the last checkpoint only.
+  checkpoints.frames.resize(checkpoints.checkpoints.back().frameCount);
+}
+
+/**
+ * Follows all epsilon transitions, rule invocations and rule ends from the
+ * given configurations, as the parser does before matching the next token.
+ *
+ * @param checkpoints Receives the frames of invoked rules.
+ * @param pending The configurations to start with. Emptied.
+ * @param tokenIndex The index of the next token, where invoked rules start.
+ * @returns The configurations ready to match the next token.
+ */
+std::vector<Checkpoints::Configuration> CodeCompletionCore::closure(
+    Checkpoints& checkpoints, std::vector<Checkpoints::Configuration>& pending, size_t tokenIndex
+) {
+  using Configuration = Checkpoints::Configuration;
+
+  // The checkpoints depend on all predicates the closure consults.
+  std::vector<std::pair<size_t, bool>>* const trace =
+      std::exchange(predicateTrace, &checkpoints.predicates);
+
+  std::vector<Configuration> result;
+  std::unordered_set<size_t> seen;
+
+  // Rules invoked from the same place share their frame.
+  std::unordered_map<Checkpoints::Frame, size_t, Checkpoints::FrameHash> invoked;
+
+  while (!pending.empty()) {
+    const Configuration configuration = pending.back();
+    pending.pop_back();
+    if (!seen.insert(configuration.frame * atn->states.size() + configuration.state).second) {
+      continue;
+    }
+
+    const antlr4::atn::ATNState* state = atn->states[configuration.state];
+    if (state->getStateType() == antlr4::atn::ATNStateType::RULE_STOP) {
+      // Nothing follows the end of the start rule.
+      const Checkpoints::Frame& frame = checkpoints.frames[configuration.frame];
+      if (frame.parent != Checkpoints::NoFrame) {
+        pending.push_back({.state = frame.returnState, .frame = frame.parent});
+      }
+      continue;
+    }
+
+    bool isReady = false;
+    for (const antlr4::atn::ConstTransitionPtr& transition : state->transitions) {
+      const Configuration next = {
+          .state = transition->target->stateNumber,
+          .frame = configuration.frame,
+      };
+      switch (transition->getTransitionType()) {
+        case antlr4::atn::TransitionType::RULE: {
+          const auto* ruleTransition =
+              dynamic_cast<const antlr4::atn::RuleTransition*>(transition.get());
+          const Checkpoints::Frame frame = {
+              .parent = configuration.frame,
+              .returnState = ruleTransition->followState->stateNumber,
+              .ruleIndex = ruleTransition->target->ruleIndex,
+              .startTokenIndex = tokenIndex,
+              .precedence = ruleTransition->precedence,
+          };
+          const auto [iter, inserted] = invoked.try_emplace(frame, checkpoints.frames.size());
+          if (inserted) {
+            checkpoints.frames.push_back(frame);
+          }
+          pending.push_back({.state = next.state, .frame = iter->second});
+        } break;
+
+        case antlr4::atn::TransitionType::PREDICATE: {
+          if (checkPredicate(
+                  dynamic_cast<const antlr4::atn::PredicateTransition*>(transition.get())
+              )) {
+            pending.push_back(next);
+          }
+        } break;
+
+        case antlr4::atn::TransitionType::PRECEDENCE: {
+          const auto* predTransition =
+              dynamic_cast<const antlr4::atn::PrecedencePredicateTransition*>(transition.get());
+          if (predTransition->getPrecedence() >=
+              checkpoints.frames[configuration.frame].precedence) {
+            pending.push_back(next);
+          }
+        } break;
+
+        default: {
+          if (transition->isEpsilon()) {
+            pending.push_back(next);
+          } else {
+            isReady = true;
+          }
+        }
+      }
+    }
+
+    if (isReady) {
+      result.push_back(configuration);
+    }
+  }
+
+  predicateTrace = trace;
+  return result;
+}
+
+/**
+ * Continues the walk from the configurations of a checkpoint. The rule of
+ * each frame is walked from the states waiting in it, and the calling rule
+ * then continues at the return state with the positions where the rule ended.
+ *
+ * @param checkpoints The checkpoints of the input.
+ * @param checkpoint The checkpoint to continue from.
+ * @param tokenListIndex The token list index of the checkpoint.
+ * @param timedOut Set to true if the walk was cancelled or timed out.
+ */
+void CodeCompletionCore::resumeWalk(
+    const Checkpoints& checkpoints,
+    const Checkpoints::Checkpoint& checkpoint,
+    size_t tokenListIndex,
+    bool& timedOut
+) {
+  // Frames come after their parents, so taking the highest frame first walks
+  // all rules before those which invoked them.
+  std::map<size_t, std::vector<PipelineEntry>> waiting;
+  const auto configurations = std::span(checkpoints.configurations)
+                                  .subspan(
+                                      checkpoint.configurationOffset, checkpoint.configurationCount
+                                  );
+  for (const Checkpoints::Configuration& configuration : configurations) {
+    waiting[configuration.frame].push_back({
+        .state = atn->states[configuration.state],
+        .tokenListIndex = tokenListIndex,
+    });
+  }
+
+  timedOut = false;
+  RuleWithStartTokenList callStack;
+  while (!waiting.empty()) {
+    auto entries = waiting.extract(std::prev(waiting.end()));
+    const Checkpoints::Frame& frame = checkpoints.frames[entries.key()];
+
+    callStack.clear();
+    precedenceStack.clear();
+    for (size_t index = entries.key(); index != Checkpoints::NoFrame;
+         index = checkpoints.frames[index].parent) {
+      const Checkpoints::Frame& invocation = checkpoints.frames[index];
+      callStack.push_back({
+          .startTokenIndex = invocation.startTokenIndex,
+          .ruleIndex = invocation.ruleIndex,
+      });
+      if (atn->ruleToStartState[invocation.ruleIndex]->isLeftRecursiveRule) {
+        precedenceStack.push_back(invocation.precedence);
+      }
+    }
+    std::ranges::reverse(callStack);
+    std::ranges::reverse(precedenceStack);
+
+    const RuleEndStatus ends =
+        walkRule(atn->ruleToStartState[frame.ruleIndex], entries.mapped(), callStack, 0, timedOut);
+    if (timedOut) {
+      return;
+    }
+
+    if (frame.parent != Checkpoints::NoFrame) {
+      for (const size_t end : ends) {
+        waiting[frame.parent].push_back({
+            .state = atn->states[frame.returnState],
+            .tokenListIndex = end,
+        });
+      }
+    }
+  }
+}
+
+/**
+ * Walks the ATN states of one rule, starting with the given states, and
+ * collects the candidates found at the caret.
+ *
+ * @param startState The start state of the rule.
+ * @param entries The states to start with, and their token list indexes.
+ * @param callStack The stack that indicates where in the ATN we are currently.
+ * @param indentation A value to determine the current indentation when doing
+ * debug prints.
+ * @param timedOut Set to true if the walk was cancelled or timed out.
+ * @returns the set of token list indexes at which the rule ends.
+ */
+CodeCompletionCore::RuleEndStatus CodeCompletionCore::walkRule(  // NOLINT
+    antlr4::atn::RuleStartState* startState,
+    std::span<const PipelineEntry> entries,
+    RuleWithStartTokenList& callStack,
+    size_t indentation,  // NOLINT
+    bool& timedOut
+) {
+  RuleEndStatus result;
+
   // The current state execution pipeline contains all yet-to-be-processed ATN
   // states in this rule. For each such state we store the token index + a list
   // of rules that lead to it.
   std::vector<PipelineEntry> statePipeline;
 
+  // In best-first order the pipeline is a max heap, with the entry closest to
+  // the caret, then the one with the fewest rule walks, then the most recent
+  // one on top. The latter keeps the order close to the depth-first one.
+  const bool bestFirst = order == ExplorationOrder::BestFirst;
+  const auto lowerPriority = [](const PipelineEntry& lhs, const PipelineEntry& rhs) {
+    return std::tuple(lhs.tokenListIndex, rhs.ruleEntries, lhs.sequence) <
+           std::tuple(rhs.tokenListIndex, lhs.ruleEntries, rhs.sequence);
+  };
+
+  // All configurations (state + token index) seen in this rule walk. Within
+  // one walk the call stack and the precedence are fixed, so processing a
+  // configuration a second time cannot produce anything new.
+  std::unordered_set<size_t> visited;
+
+  // States from which the next input token cannot be matched are dropped
+  // right away. At the caret everything is kept, as that's where we collect.
+  size_t sequence = 0;
+  const auto pushState = [&](antlr4::atn::ATNState* state, size_t index, size_t ruleEntries) {
+    furthestPosition = std::max(furthestPosition, index);
+    const bool beforeCaret = index < tokens.size() - 1;
+    if (viabilityOnly && !beforeCaret) {
+      reachedCaret = true;
+      return;
+    }
+    if (beforeCaret && !analysis->canContinue(state->stateNumber, tokens[index].type)) {
+      ++stats.statesPruned;
+      return;
+    }
+
+    if (!debugOptions.disableStateMerging &&
+        !visited.insert(state->stateNumber * tokens.size() + index).second) {
+      ++stats.statesMerged;
+      return;
+    }
+
+    statePipeline.push_back({
+        .state = state,
+        .tokenListIndex = index,
+        .ruleEntries = ruleEntries,
+        .sequence = sequence++,
+    });
+    if (bestFirst) {
+      std::ranges::push_heap(statePipeline, lowerPriority);
+    }
+  };
+
   // Bootstrap the pipeline.
-  statePipeline.push_back({.state = startState, .tokenListIndex = tokenListIndex});
+  for (const PipelineEntry& entry : entries) {
+    pushState(entry.state, entry.tokenListIndex, entry.ruleEntries);
+  }
 
   while (!statePipeline.empty()) {
-    if (cancel != nullptr && cancel->load()) {
+    if ((cancel != nullptr && cancel->load()) || isOverBudget() || reachedCaret) {
       timedOut = true;
       return {};
     }
 
+    if (bestFirst) {
+      std::ranges::pop_heap(statePipeline, lowerPriority);
+    }
     const PipelineEntry currentEntry = statePipeline.back();
     statePipeline.pop_back();
-    ++statesProcessed;
+    ++stats.statesProcessed;
 
-    const size_t currentSymbol = tokens[currentEntry.tokenListIndex]->getType();
+    const size_t currentSymbol = tokens[currentEntry.tokenListIndex].type;
 
     const bool atCaret = currentEntry.tokenListIndex >= tokens.size() - 1;
     if (debugOptions.showDebugOutput) {
@@ -593,6 +1544,21 @@ CodeCompletionCore::RuleEndStatus CodeCompletionCore::processRule(  // NOLINT
       continue;
     }
 
+    // The operator loop of a left-recursive rule: jump directly to the
+    // operator alternatives which can match the current token and whose
+    // precedence is high enough, instead of checking every alternative.
+    if (!atCaret && startState->isLeftRecursiveRule && !debugOptions.disableOperatorTables) {
+      const OperatorTable* operators = analysis->operatorTable(currentEntry.state->stateNumber);
+      if (operators != nullptr) {
+        for (const PrecedenceAlternative& alternative : operators->alternatives(currentSymbol)) {
+          if (alternative.precedence >= precedenceStack.back()) {
+            pushState(alternative.target, currentEntry.tokenListIndex, currentEntry.ruleEntries);
+          }
+        }
+        continue;
+      }
+    }
+
     // We simulate here the same precedence handling as the parser does, which
     // uses hard coded values. For rules that are not left recursive this value
     // is ignored (since there is no precedence transition).
@@ -602,6 +1568,11 @@ CodeCompletionCore::RuleEndStatus CodeCompletionCore::processRule(  // NOLINT
           const auto* ruleTransition =
               dynamic_cast<const antlr4::atn::RuleTransition*>(transition.get());
           auto* ruleStartState = dynamic_cast<antlr4::atn::RuleStartState*>(ruleTransition->target);
+          if (!atCaret && !analysis->canContinue(ruleStartState->stateNumber, currentSymbol)) {
+            ++stats.statesPruned;
+            break;
+          }
+
           bool innerCancelled = false;
           const RuleEndStatus endStatus = processRule(
               ruleStartState,
@@ -618,10 +1589,7 @@ CodeCompletionCore::RuleEndStatus CodeCompletionCore::processRule(  // NOLINT
           }
 
           for (const size_t position : endStatus) {
-            statePipeline.push_back({
-                .state = ruleTransition->followState,
-                .tokenListIndex = position,
-            });
+            pushState(ruleTransition->followState, position, currentEntry.ruleEntries + 1);
           }
 
         } break;
@@ -630,10 +1598,7 @@ CodeCompletionCore::RuleEndStatus CodeCompletionCore::processRule(  // NOLINT
           const auto* predTransition =
               dynamic_cast<const antlr4::atn::PredicateTransition*>(transition.get());
           if (checkPredicate(predTransition)) {
-            statePipeline.push_back({
-                .state = transition->target,
-                .tokenListIndex = currentEntry.tokenListIndex,
-            });
+            pushState(transition->target, currentEntry.tokenListIndex, currentEntry.ruleEntries);
           }
 
         } break;
@@ -642,10 +1607,7 @@ CodeCompletionCore::RuleEndStatus CodeCompletionCore::processRule(  // NOLINT
           const auto* predTransition =
               dynamic_cast<const antlr4::atn::PrecedencePredicateTransition*>(transition.get());
           if (predTransition->getPrecedence() >= precedenceStack[precedenceStack.size() - 1]) {
-            statePipeline.push_back({
-                .state = transition->target,
-                .tokenListIndex = currentEntry.tokenListIndex,
-            });
+            pushState(transition->target, currentEntry.tokenListIndex, currentEntry.ruleEntries);
           }
 
         } break;
@@ -655,16 +1617,15 @@ CodeCompletionCore::RuleEndStatus CodeCompletionCore::processRule(  // NOLINT
             if (!translateStackToRuleIndex(callStack)) {
               for (const auto token :
                    std::views::iota(antlr4::Token::MIN_USER_TOKEN_TYPE, atn->maxTokenType + 1)) {
-                if (!ignoredTokens.contains(token)) {
+                if (isTokenCandidate(token)) {
                   candidates.tokens[token] = {};
                 }
               }
             }
           } else {
-            statePipeline.push_back({
-                .state = transition->target,
-                .tokenListIndex = currentEntry.tokenListIndex + 1,
-            });
+            pushState(
+                transition->target, currentEntry.tokenListIndex + 1, currentEntry.ruleEntries
+            );
           }
 
         } break;
@@ -673,10 +1634,7 @@ CodeCompletionCore::RuleEndStatus CodeCompletionCore::processRule(  // NOLINT
           if (transition->isEpsilon()) {
             // Jump over simple states with a single outgoing epsilon
             // transition.
-            statePipeline.push_back({
-                .state = transition->target,
-                .tokenListIndex = currentEntry.tokenListIndex,
-            });
+            pushState(transition->target, currentEntry.tokenListIndex, currentEntry.ruleEntries);
             continue;
           }
 
@@ -687,25 +1645,24 @@ CodeCompletionCore::RuleEndStatus CodeCompletionCore::processRule(  // NOLINT
             }
             if (atCaret) {
               if (!translateStackToRuleIndex(callStack)) {
-                const std::vector<ptrdiff_t> list = set.toList();
-                const bool hasTokenSequence = list.size() == 1;
-                for (const size_t symbol : list) {
+                const bool hasTokenSequence = set.size() == 1;
+                for (const size_t symbol : candidateTokens(set).toList()) {
                   if (!ignoredTokens.contains(symbol)) {
                     if (debugOptions.showDebugOutput) {
                       std::cout << "=====> collected:  " << vocabulary->getDisplayName(symbol)
                                 << "\n";
                     }
 
-                    std::vector<size_t> followingTokens;
+                    std::span<const size_t> followingTokens;
                     if (hasTokenSequence) {
-                      followingTokens = getFollowingTokens(transition.get());
+                      followingTokens = analysis->followingTokens(transition->target->stateNumber);
                     }
 
-                    if (!candidates.tokens.contains(symbol)) {
-                      candidates.tokens[symbol] = followingTokens;
-                    } else {
-                      candidates.tokens[symbol] =
-                          longestCommonPrefix(followingTokens, candidates.tokens[symbol]);
+                    const auto [iter, inserted] = candidates.tokens.try_emplace(
+                        symbol, followingTokens.begin(), followingTokens.end()
+                    );
+                    if (!inserted) {
+                      truncateToCommonPrefix(iter->second, followingTokens);
                     }
                   }
                 }
@@ -716,10 +1673,9 @@ CodeCompletionCore::RuleEndStatus CodeCompletionCore::processRule(  // NOLINT
                   std::cout << "=====> consumed:  " << vocabulary->getDisplayName(currentSymbol)
                             << "\n";
                 }
-                statePipeline.push_back({
-                    .state = transition->target,
-                    .tokenListIndex = currentEntry.tokenListIndex + 1,
-                });
+                pushState(
+                    transition->target, currentEntry.tokenListIndex + 1, currentEntry.ruleEntries
+                );
               }
             }
           }
@@ -728,14 +1684,6 @@ CodeCompletionCore::RuleEndStatus CodeCompletionCore::processRule(  // NOLINT
     }
   }
 
-  callStack.pop_back();
-  if (startState->isLeftRecursiveRule) {
-    precedenceStack.pop_back();
-  }
-
-  // Cache the result, for later lookup to avoid duplicate walks.
-  positionMap[tokenListIndex] = result;
-
   return result;
 }
 
@@ -745,6 +1693,61 @@ antlr4::misc::IntervalSet CodeCompletionCore::allUserTokens() const {
   return antlr4::misc::IntervalSet::of(min, max);
 }
 
+/**
+ * @param symbol A token type found at the caret.
+ * @returns true if the token is neither ignored nor excluded by the prefix.
+ */
+bool CodeCompletionCore::isTokenCandidate(size_t symbol) const {
+  return !ignoredTokens.contains(symbol) &&
+         (!prefixTokens.has_value() || prefixTokens->contains(symbol));
+}
+
+/**
+ * @param set A set of token types found at the caret.
+ * @returns The part of the set which matches the prefix, if one was given.
+ * This avoids listing tokens which would be filtered out anyway.
+ */
+antlr4::misc::IntervalSet CodeCompletionCore::candidateTokens(antlr4::misc::IntervalSet const& set
+) const {
+  if (!prefixTokens.has_value()) {
+    return set;
+  }
+  return set.And(prefixIntervals);
+}
+
+size_t CodeCompletionCore::memoBytes() const {
+  size_t bytes = 0;
+
+  bytes += vectorBytes(shortcutMap);
+  for (const PositionMap& positionMap : shortcutMap) {
+    for (const auto& [key, endStatus] : positionMap) {
+      bytes += sizeof(key) + sizeof(endStatus) + HashNodeOverhead;
+      bytes += endStatus.size() * (sizeof(size_t) + HashNodeOverhead);
+    }
+  }
+
+  for (const auto& [token, following] : candidates.tokens) {
+    bytes += sizeof(token) + sizeof(following) + TreeNodeOverhead + vectorBytes(following);
+  }
+
+  for (const auto& [ruleIndex, rule] : candidates.rules) {
+    bytes += sizeof(ruleIndex) + sizeof(rule) + TreeNodeOverhead + vectorBytes(rule.ruleList);
+  }
+
+  for (const auto& [ruleIndex, occurrences] : candidates.ruleOccurrences) {
+    bytes += sizeof(ruleIndex) + sizeof(occurrences) + TreeNodeOverhead + vectorBytes(occurrences);
+  }
+  bytes += vectorBytes(candidates.rulePaths);
+  for (const auto& [key, endStatus] : parsedRules) {
+    bytes += sizeof(key) + sizeof(endStatus) + HashNodeOverhead;
+    bytes += endStatus.size() * (sizeof(size_t) + HashNodeOverhead);
+  }
+  bytes += (rulePathsByHash.size() + occurrencesByHash.size()) *
+           (sizeof(size_t) + sizeof(std::pair<size_t, size_t>) + HashNodeOverhead);
+
+  return bytes;
+}
+
 std::string CodeCompletionCore::generateBaseDescription(antlr4::atn::ATNState* state) {
   const std::string stateValue = (state->stateNumber == antlr4::atn::ATNState::INVALID_STATE_NUMBER)
                                      ? "Invalid"
@@ -830,7 +1833,7 @@ void CodeCompletionCore::printOverallResults() {
       std::cout << "*** TIMED OUT ***\n";
     }
 
-    std::cout << "States processed: " << statesProcessed << "\n";
+    std::cout << "States processed: " << stats.statesProcessed << "\n";
 
     std::cout << "\n\nCollected rules:\n\n";
     for (const auto& [tokenIndex, rule] : candidates.rules) {
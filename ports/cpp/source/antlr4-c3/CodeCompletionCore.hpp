@@ -7,10 +7,18 @@
 
 #pragma once
 
+#include "Checkpoints.hpp"
+#include "FollowSetsTables.hpp"
+#include "GrammarAnalysis.hpp"
+#include "GrammarModel.hpp"
+#include "IndexSet.hpp"
+
 #include <Parser.h>
 #include <ParserRuleContext.h>
 #include <Token.h>
+#include <TokenStream.h>
 #include <Vocabulary.h>
+#include <atn/ATN.h>
 #include <atn/ATNState.h>
 #include <atn/PredicateTransition.h>
 #include <atn/RuleStartState.h>
@@ -20,16 +28,22 @@
 #include <atomic>
 #include <chrono>
 #include <cstddef>
+#include <functional>
 #include <map>
+#include <memory>
 #include <optional>
+#include <span>
 #include <string>
-#include <typeindex>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace c3 {
 
+class GrammarMetrics;
+
 using TokenList = std::vector<size_t>;
 
 using RuleList = std::vector<size_t>;
@@ -41,6 +55,19 @@ struct CandidateRule {
   friend bool operator==(const CandidateRule& lhs, const CandidateRule& rhs) = default;
 };
 
+/**
+ * One way in which a preferred rule was found. The call path is stored in
+ * `CandidatesCollection::rulePaths`, shared by all occurrences with the same
+ * path.
+ */
+struct RuleOccurrence {
+  size_t startTokenIndex;
+  size_t pathOffset;
+  size_t pathLength;
+
+  friend bool operator==(const RuleOccurrence& lhs, const RuleOccurrence& rhs) = default;
+};
+
 /**
  * All the candidates which have been found. Tokens and rules are separated.
  * – Token entries include a list of tokens that directly follow them (see also
@@ -54,10 +81,44 @@ struct CandidatesCollection {
   std::map<size_t, CandidateRule> rules;
   bool isCancelled;
 
+  /**
+   * Only filled if `Parameters::collectRulePaths` is set: every distinct
+   * start token and call path with which each preferred rule was found.
+   * `rules` holds only one of them per rule.
+   */
+  std::map<size_t, std::vector<RuleOccurrence>> ruleOccurrences;
+
+  /** Storage for the call paths of `ruleOccurrences`. */
+  RuleList rulePaths;
+
+  /**
+   * @param occurrence An entry of `ruleOccurrences`.
+   * @returns The rule indexes on the call path of the occurrence.
+   */
+  [[nodiscard]] std::span<const size_t> path(const RuleOccurrence& occurrence) const {
+    return std::span(rulePaths).subspan(occurrence.pathOffset, occurrence.pathLength);
+  }
+
   friend bool operator==(const CandidatesCollection& lhs, const CandidatesCollection& rhs) =
       default;
 };
 
+/**
+ * The order in which the ATN states of a rule are explored.
+ */
+enum class ExplorationOrder {
+  /** Last in, first out. The order found depends on the transition order in the ATN. */
+  DepthFirst,
+
+  /**
+   * States closest to the caret first (i.e. those which consumed the most
+   * input), ties broken by the fewest rule walks on the way there. With a
+   * timeout or a state budget this yields the candidates nearest to the caret
+   * first, instead of an arbitrary subset.
+   */
+  BestFirst,
+};
+
 /**
  * Optional parameters for `CodeCompletionCore`.
  */
@@ -65,6 +126,28 @@ struct Parameters {
   /** An option parser rule context to limit the search space. */
   const antlr4::ParserRuleContext* context = nullptr;
 
+  /**
+   * The parse tree of the input, if there is one. Error free subtrees whose
+   * input ends before the token preceding the caret are then taken as parsed:
+   * the walk continues behind them instead of simulating their rules again.
+   * Subtrees of left-recursive rules are always walked. Other ways to match
+   * the skipped input are not considered, so the candidates are those
+   * following the parser's interpretation of the input. Token indexes in the
+   * tree must refer to the completed token stream.
+   */
+  const antlr4::ParserRuleContext* parseTree = nullptr;
+
+  /**
+   * Checkpoints of the input, kept by the caller for as long as the input
+   * does not change (e.g. one per open document). The walk then continues
+   * from the last checkpoint before the caret instead of starting at the
+   * first token, and new checkpoints are recorded up to the caret. Not used
+   * together with `context`. Checkpoints recorded with other outcomes of the
+   * semantic predicates are discarded, and the walk starts at the first
+   * token.
+   */
+  Checkpoints* checkpoints = nullptr;
+
   /** If non-zero, the number of milliseconds until collecting times out. */
   std::optional<std::chrono::milliseconds> timeout = std::nullopt;
 
@@ -74,6 +157,27 @@ struct Parameters {
    * as soon as possible.
    */
   std::atomic<bool>* isCancelled = nullptr;
+
+  /** The order in which ATN states are explored. */
+  ExplorationOrder order = ExplorationOrder::DepthFirst;
+
+  /**
+   * If set, the maximum number of ATN states to process. Unlike a timeout,
+   * this budget makes the (partial) result deterministic. Exceeding it marks
+   * the result as cancelled.
+   */
+  std::optional<size_t> maxStates = std::nullopt;
+
+  /** If true, fill `CandidatesCollection::ruleOccurrences`. */
+  bool collectRulePaths = false;
+
+  /**
+   * The partially typed word at the caret, if any. Only tokens whose literal
+   * name (or symbolic name, if there is no literal) starts with this text,
+   * compared case-insensitively, are collected. Rule candidates are not
+   * affected. Tokens following a candidate are not filtered either.
+   */
+  std::string_view prefix = {};
 };
 
 struct DebugOptions {
@@ -99,13 +203,120 @@ struct DebugOptions {
    * Enables call stack printing for each rule recursion.
    */
   bool showRuleStack = false;
+
+  /**
+   * Processes configurations (state and token position) again when they are
+   * reached a second time within a rule walk, instead of merging them (see
+   * `Statistics::statesMerged`). The candidates stay the same, only the work
+   * to find them grows. Meant for comparing against the plain walk.
+   */
+  bool disableStateMerging = false;
+
+  /**
+   * Descends into every invoked rule while determining follow sets, instead
+   * of taking the follow sets of rules which cannot invoke themselves from
+   * the cache. The follow sets stay the same. Meant for comparing against
+   * the plain walk.
+   */
+  bool disableFollowSetsSplicing = false;
+
+  /**
+   * Checks every operator alternative of a left-recursive rule, instead of
+   * only those the rule's operator table lists for the current token. The
+   * candidates stay the same. Meant for comparing against the plain walk.
+   */
+  bool disableOperatorTables = false;
+};
+
+/**
+ * Work counters of a `collectCandidates` call. They only depend on the
+ * grammar, the input, the configuration and the state of the follow sets
+ * cache, never on timing, which makes them suitable for detecting algorithmic
+ * regressions.
+ */
+struct Statistics {
+  /** Number of ATN states taken from the state pipelines. */
+  size_t statesProcessed = 0;
+
+  /** Number of rule walks started, including those answered by the shortcut map. */
+  size_t ruleInvocations = 0;
+
+  /** Number of rule walks answered by the shortcut map. */
+  size_t shortcutHits = 0;
+
+  /**
+   * Number of follow sets cache lookups, including those for rules whose
+   * follow sets are spliced into those of other rules.
+   */
+  size_t followSetsLookups = 0;
+
+  /** Number of follow sets which were not in the cache and had to be determined. */
+  size_t followSetsComputed = 0;
+
+  /** Number of ATN states visited while determining follow sets. */
+  size_t followSetsStates = 0;
+
+  /**
+   * Number of states and rule walks not taken, because the grammar analysis
+   * proved they cannot match the next input token.
+   */
+  size_t statesPruned = 0;
+
+  /** Number of semantic predicates evaluated through the parser. */
+  size_t predicateEvaluations = 0;
+
+  /** Number of states not processed again, as they were reached before in the same rule walk. */
+  size_t statesMerged = 0;
+
+  /** Number of rule walks replaced by an error free subtree of `Parameters::parseTree`. */
+  size_t rulesSkipped = 0;
+
+  /** Number of tokens simulated to record `Parameters::checkpoints`. */
+  size_t tokensSimulated = 0;
+};
+
+/**
+ * Approximate memory consumption (in bytes) of the data kept by a
+ * `CodeCompletionCore`. The values are estimates based on element counts and
+ * container capacities, not on allocator statistics.
+ */
+struct MemoryUsage {
+  /**
+   * Bytes held by the follow sets cache of the grammar model. This cache is
+   * shared by all instances using the same model.
+   */
+  size_t followSetsBytes = 0;
+
+  /** Number of rule start states whose follow sets are currently cached. */
+  size_t followSetsEntries = 0;
+
+  /** Number of follow sets entries evicted so far to honor the memory limit. */
+  size_t followSetsEvictions = 0;
+
+  /**
+   * Bytes held by the per-call memo structures (shortcut map and collected
+   * candidates) of the last `collectCandidates` call.
+   */
+  size_t memoBytes = 0;
 };
 
 class CodeCompletionCore {
 private:
+  /** An input token, reduced to what the ATN walk needs. */
+  struct InputToken {
+    size_t type;
+    size_t tokenIndex;
+  };
+
   struct PipelineEntry {
     antlr4::atn::ATNState* state;
     size_t tokenListIndex;
+
+    /** Number of rule walks taken within the current rule to get here. */
+    size_t ruleEntries = 0;
+
+    /** Insertion order, to keep the best-first order deterministic. */
+    size_t sequence = 0;
   };
 
   struct RuleWithStartToken {
@@ -115,54 +326,90 @@ private:
 
   using RuleWithStartTokenList = std::vector<RuleWithStartToken>;
 
-  /**
-   * A record for a follow set along with the path at which this set was found.
-   * If there is only a single symbol in the interval set then we also collect and
-   * store tokens which follow this symbol directly in its rule (i.e. there is no
-   * intermediate rule transition). Only single label transitions are considered.
-   * This is useful if you have a chain of tokens which can be suggested as a
-   * whole, because there is a fixed sequence in the grammar.
-   */
-  struct FollowSetWithPath {
-    antlr4::misc::IntervalSet intervals;
-    RuleList path;
-    TokenList following;
-  };
+  /** Token stream position info after a rule was processed. */
+  using RuleEndStatus = std::unordered_set<size_t>;
 
   /**
-   * A list of follow sets (for a given state number) + all of them combined for
-   * quick hit tests + whether they are exhaustive (false if subsequent
-   * yet-unprocessed rules could add further tokens to the follow set, true
-   * otherwise). This data is static in nature (because the used ATN states are
-   * part of a static struct: the ATN). Hence it can be shared between all C3
-   * instances, however it depends on the actual parser class (type).
+   * The start of a rule walk within one rule. Precedence predicates make the
+   * walk of a left-recursive rule depend on the precedence it was invoked
+   * with. For other rules the precedence is always 0, so their walks are
+   * shared between all callers.
    */
-  struct FollowSetsHolder {
-    std::vector<FollowSetWithPath> sets;
-    antlr4::misc::IntervalSet combined;
-    bool isExhaustive;
+  struct MemoKey {
+    size_t tokenListIndex;
+    int precedence;
+
+    friend bool operator==(const MemoKey& lhs, const MemoKey& rhs) = default;
   };
 
-  using FollowSetsPerState = std::unordered_map<size_t, FollowSetsHolder>;
+  struct MemoKeyHash {
+    size_t operator()(const MemoKey& key) const noexcept;
+  };
 
-  /** Token stream position info after a rule was processed. */
-  using RuleEndStatus = std::unordered_set<size_t>;
+  /** The end positions of the walks of one rule, by their start. */
+  using PositionMap = std::unordered_map<MemoKey, RuleEndStatus, MemoKeyHash>;
 
 public:
+  /**
+   * Creates an engine for the parser's grammar, using a model shared with all
+   * other instances for the same parser type in the process.
+   *
+   * @param parser The parser whose token stream is completed and which
+   * evaluates semantic predicates.
+   */
   explicit CodeCompletionCore(antlr4::Parser* parser);
 
+  /**
+   * Creates an engine without a parser, using a model shared with all other
+   * instances for the same ATN and vocabulary in the process. Candidates can
+   * then be collected for token type sequences or an explicitly passed token
+   * stream.
+   *
+   * @param atn The parser ATN. Must outlive the engine.
+   * @param vocabulary The parser vocabulary. Must outlive the engine.
+   * @param ruleNames The parser rule names.
+   * @param grammarName The name under which metrics are recorded.
+   * @param predicateEvaluator Evaluates the semantic predicates of the grammar.
+   * Without it, all predicates are assumed to hold.
+   */
+  CodeCompletionCore(
+      const antlr4::atn::ATN& atn,
+      const antlr4::dfa::Vocabulary& vocabulary,
+      std::vector<std::string> const& ruleNames,
+      std::string const& grammarName = {},
+      PredicateEvaluator predicateEvaluator = {}
+  );
+
+  /**
+   * Creates a per-request context for the given model. Contexts are cheap to
+   * create, hold no grammar data of their own and can be reused for any number
+   * of sequential requests (e.g. from a pool), while any number of contexts
+   * for the same model run concurrently. The tailoring fields start with the
+   * model's options.
+   *
+   * @param model The grammar model.
+   * @param parser The parser whose token stream is completed and which
+   * evaluates semantic predicates. It must be of the model's grammar and is
+   * used by this context only. Optional: without a parser, semantic predicates
+   * not answered by `predicateEvaluator` are assumed to hold, and the caret
+   * index overload of `collectCandidates` needs an explicit token stream.
+   */
+  explicit CodeCompletionCore(
+      std::shared_ptr<const GrammarModel> model, antlr4::Parser* parser = nullptr
+  );
+
   /**
    * Tailoring of the result:
    * Tokens which should not appear in the candidates set.
    */
-  std::unordered_set<size_t> ignoredTokens;  // NOLINT: public field
+  IndexSet ignoredTokens;  // NOLINT: public field
 
   /**
    * Rules which replace any candidate token they contain.
    * This allows to return descriptive rules (e.g. className, instead of
    * ID/identifier).
    */
-  std::unordered_set<size_t> preferredRules;  // NOLINT: public field
+  IndexSet preferredRules;  // NOLINT: public field
 
   /**
    * Specify if preferred rules should translated top-down (higher index rule
@@ -175,6 +422,16 @@ public:
    */
   DebugOptions debugOptions;  // NOLINT: public field
 
+  /**
+   * If set, called once at the start of each `collectCandidates` call with all
+   * semantic predicates of the grammar, instead of evaluating every predicate
+   * through the parser when the walk first reaches it. Starts with the
+   * model's evaluator. Useful when predicates
+   * only depend on settings (e.g. a dialect), which the hook can look up once.
+   * Either way, each predicate is evaluated at most once per call.
+   */
+  PredicateEvaluator predicateEvaluator;  // NOLINT: public field
+
   /**
    * This is the main entry point. The caret token index specifies the token
    * stream index for the token which currently covers the caret (or any other
@@ -188,29 +445,194 @@ public:
    * @returns The collection of completion candidates. If cancelled or timed
    * out, the returned collection will have its 'cancelled' value set to true
    * and the collected candidates may be incomplete.
+   * @throws std::logic_error If the engine has no parser. Pass the token
+   * stream explicitly then.
    */
   CandidatesCollection collectCandidates(size_t caretTokenIndex, Parameters parameters = {});
 
+  /**
+   * Like the caret index overload, but reads the input from the given token
+   * stream instead of the parser's. This is the overload to use for engines
+   * created without a parser.
+   *
+   * @param tokenStream The (filled) token stream to complete.
+   * @param caretTokenIndex The index of the token at the caret position.
+   * @param parameters Optional parameters.
+   * @returns The collection of completion candidates.
+   */
+  CandidatesCollection collectCandidates(
+      antlr4::TokenStream& tokenStream, size_t caretTokenIndex, Parameters parameters = {}
+  );
+
+  /**
+   * Collects candidates for a plain sequence of token types instead of the
+   * parser's token stream, e.g. for input produced by a generator or a foreign
+   * lexer. The sequence must not contain hidden tokens. Candidates are
+   * collected for the position following the last given token type. Start
+   * token indexes of rule candidates are positions in `tokenTypes`.
+   *
+   * @param tokenTypes The token types before the caret.
+   * @param parameters Optional parameters. A context only selects the start
+   * rule here, the walk always starts at the first given token type.
+   * @returns The collection of completion candidates.
+   */
+  CandidatesCollection collectCandidates(
+      std::span<const size_t> tokenTypes, Parameters parameters = {}
+  );
+
+  /**
+   * Checks whether the tokens before the caret can start a valid input, i.e.
+   * whether a parser would not report a syntax error before the caret. This
+   * uses the same walk and caches as `collectCandidates`, but collects no
+   * candidates and stops as soon as the caret is reached, which is much
+   * cheaper than a full parse with error recovery. `furthestViableToken`
+   * then tells where the input stops being viable. A cancelled or timed out
+   * check returns false. Checks are not recorded in the `MetricsRegistry`.
+   *
+   * @param caretTokenIndex The index of the token at the caret position. This
+   * token itself is not checked.
+   * @param parameters Optional parameters. Those tailoring the candidates
+   * have no effect.
+   * @returns true if the input before the caret is viable.
+   * @throws std::logic_error If the engine has no parser. Pass the token
+   * stream explicitly then.
+   */
+  bool isViablePrefix(size_t caretTokenIndex, Parameters parameters = {});
+
+  /**
+   * Like the caret index overload, but reads the input from the given token
+   * stream instead of the parser's.
+   *
+   * @param tokenStream The (filled) token stream to check.
+   * @param caretTokenIndex The index of the token at the caret position.
+   * @param parameters Optional parameters.
+   * @returns true if the input before the caret is viable.
+   */
+  bool isViablePrefix(
+      antlr4::TokenStream& tokenStream, size_t caretTokenIndex, Parameters parameters = {}
+  );
+
+  /**
+   * Checks whether a plain sequence of token types can start a valid input.
+   *
+   * @param tokenTypes The token types to check, all of them.
+   * @param parameters Optional parameters.
+   * @returns true if the token types are viable.
+   */
+  bool isViablePrefix(std::span<const size_t> tokenTypes, Parameters parameters = {});
+
+  /**
+   * @returns The index of the furthest token reached by the last
+   * `isViablePrefix` or `collectCandidates` call: the first token no path
+   * could match (where a parser reports the syntax error), or the caret token
+   * if the input is viable. For token type sequences, the position in the
+   * sequence.
+   */
+  [[nodiscard]] size_t furthestViableToken() const;
+
+  /**
+   * Determines the follow sets of all rules ahead of time, instead of lazily
+   * when a walk first enters a rule, and stores them in the model's cache.
+   * Rules are processed in parallel, in the order given by
+   * `GrammarAnalysis::ruleLevels`, so the follow sets of invoked rules are
+   * usually available when a rule needs them. The result is the same as that
+   * of the lazy computation. Semantic predicates are evaluated once, up front,
+   * on the calling thread. `statistics` then reports the work of all threads.
+   *
+   * @param threads The number of threads to use. 0 selects the number of
+   * hardware threads.
+   */
+  void buildFollowSets(size_t threads = 0);
+
+  /**
+   * Stores follow sets generated at build time (see `writeFollowSetsTables`)
+   * in the model's cache, so no follow sets need to be determined at runtime.
+   * Follow sets depending on predicates are only used while the predicates
+   * evaluate as they did at generation time. If the tables list preferred
+   * rules, they replace `preferredRules` of this context. The grammar
+   * analysis of the model is not part of the tables and is still computed
+   * when the model is created.
+   *
+   * @param tables The generated tables.
+   * @returns false if the tables were generated for a different grammar, in
+   * which case nothing is loaded.
+   */
+  bool loadFollowSets(const FollowSetsTables& tables);
+
+  /**
+   * Reports the approximate memory held by the follow sets cache of the
+   * parser's grammar and by the memo structures of the last
+   * `collectCandidates` call.
+   *
+   * @returns The current memory usage.
+   */
+  [[nodiscard]] MemoryUsage memoryUsage() const;
+
+  /**
+   * @returns The work counters of the last `collectCandidates` call.
+   */
+  [[nodiscard]] const Statistics& statistics() const;
+
+  /**
+   * @returns The grammar model this context works on.
+   */
+  [[nodiscard]] const GrammarModel& grammarModel() const;
+
 private:
-  static thread_local std::unordered_map<std::type_index, FollowSetsPerState> followSetsByATN;
   static std::vector<std::string> atnStateTypeMap;
 
+  std::shared_ptr<const GrammarModel> model;
   antlr4::Parser* parser;
   const antlr4::atn::ATN* atn;
   const antlr4::dfa::Vocabulary* vocabulary;
   const std::vector<std::string>* ruleNames;
-  std::vector<const antlr4::Token*> tokens;
+  const GrammarAnalysis* analysis;
+  std::vector<InputToken> tokens;
   std::vector<int> precedenceStack;
 
   size_t tokenStartIndex = 0;
-  size_t statesProcessed = 0;
+
+  Statistics stats;
+
+  /** Outcomes of the predicates evaluated in this call, by predicate slot. */
+  std::vector<std::optional<bool>> predicateOutcomes;
+
+  bool collectRulePaths = false;
+
+  /** If true, the walk only checks whether the caret can be reached. */
+  bool viabilityOnly = false;
+  bool reachedCaret = false;
+
+  /** The furthest token list index reached by the walk. */
+  size_t furthestPosition = 0;
+
+  /** The tokens matching `Parameters::prefix`, if one was given. */
+  std::optional<IndexSet> prefixTokens;
+  antlr4::misc::IntervalSet prefixIntervals;
 
   /**
-   * A mapping of rule index + token stream position to end token positions.
-   * A rule which has been visited before with the same input position will
-   * always produce the same output positions.
+   * Hashes of the call paths in `candidates.rulePaths` (to their offset and
+   * length) and of the rule occurrences collected so far, for deduplication.
    */
-  std::unordered_map<size_t, std::unordered_map<size_t, RuleEndStatus>> shortcutMap;
+  std::unordered_multimap<size_t, std::pair<size_t, size_t>> rulePathsByHash;
+  std::unordered_multimap<size_t, std::pair<size_t, size_t>> occurrencesByHash;
+
+  /**
+   * The end positions of the error free subtrees of `Parameters::parseTree`,
+   * by rule index and start position (see `parsedRuleKey`).
+   */
+  std::unordered_map<size_t, RuleEndStatus> parsedRules;
+
+  /** While determining follow sets, the predicates they depend on. */
+  std::vector<std::pair<size_t, bool>>* predicateTrace = nullptr;
+
+  /**
+   * A mapping of rule index + token stream position + precedence to end token
+   * positions. A rule which has been visited before with the same input
+   * position and precedence will always produce the same output positions.
+   * Indexed by rule, with one entry per rule of the grammar.
+   */
+  std::vector<PositionMap> shortcutMap;
 
   /** The collected candidates (rules and tokens). */
   c3::CandidatesCollection candidates;
@@ -218,14 +640,40 @@ private:
   std::optional<std::chrono::milliseconds> timeout;
   std::atomic<bool>* cancel;
   std::chrono::steady_clock::time_point timeoutStart;
+  ExplorationOrder order = ExplorationOrder::DepthFirst;
+  std::optional<size_t> maxStates;
+
+  antlr4::TokenStream& parserTokenStream(const char* caller) const;
+
+  void startRequest();
+
+  void readTokens(
+      antlr4::TokenStream& tokenStream, size_t caretTokenIndex, Parameters const& parameters
+  );
+
+  void readTokens(std::span<const size_t> tokenTypes);
+
+  CandidatesCollection collect(Parameters const& parameters);
+
+  bool checkViability(Parameters const& parameters);
+
+  bool isOverBudget() const;
+
+  bool indexParseTree(const antlr4::ParserRuleContext* context);
+
+  size_t parsedRuleKey(size_t ruleIndex, size_t tokenListIndex) const;
 
   bool checkPredicate(const antlr4::atn::PredicateTransition* transition);
 
+  bool checkPredicate(size_t slot);
+
   bool translateStackToRuleIndex(RuleWithStartTokenList const& ruleWithStartTokenList);
 
   bool translateToRuleIndex(size_t index, RuleWithStartTokenList const& ruleWithStartTokenList);
 
-  static std::vector<size_t> getFollowingTokens(const antlr4::atn::Transition* transition);
+  void addRuleOccurrence(size_t index, RuleWithStartTokenList const& ruleWithStartTokenList);
+
+  std::shared_ptr<const FollowSetsHolder> ruleFollowSets(antlr4::atn::RuleStartState* startState);
 
   FollowSetsHolder determineFollowSets(antlr4::atn::ATNState* start, antlr4::atn::ATNState* stop);
 
@@ -246,8 +694,37 @@ private:
       bool& timedOut
   );
 
+  bool checkpointsMatch(const Checkpoints& checkpoints);
+
+  void extendCheckpoints(Checkpoints& checkpoints);
+
+  std::vector<Checkpoints::Configuration> closure(
+      Checkpoints& checkpoints, std::vector<Checkpoints::Configuration>& pending, size_t tokenIndex
+  );
+
+  void resumeWalk(
+      const Checkpoints& checkpoints,
+      const Checkpoints::Checkpoint& checkpoint,
+      size_t tokenListIndex,
+      bool& timedOut
+  );
+
+  RuleEndStatus walkRule(
+      antlr4::atn::RuleStartState* startState,
+      std::span<const PipelineEntry> entries,
+      RuleWithStartTokenList& callStack,
+      size_t indentation,
+      bool& timedOut
+  );
+
   antlr4::misc::IntervalSet allUserTokens() const;
 
+  bool isTokenCandidate(size_t symbol) const;
+
+  antlr4::misc::IntervalSet candidateTokens(antlr4::misc::IntervalSet const& set) const;
+
+  size_t memoBytes() const;
+
   std::string generateBaseDescription(antlr4::atn::ATNState* state);
 
   void printDescription(
@@ -0,0 +1,206 @@
+//
+//  FollowSetsTables.cpp
+//
+//  C++ port of antlr4-c3 (TypeScript) by Mike Lischke
+//  Licensed under the MIT License.
+//
+
+#include "FollowSetsTables.hpp"
+
+#include "CodeCompletionCore.hpp"
+#include "GrammarModel.hpp"
+
+#include <Parser.h>
+#include <atn/ATN.h>
+#include <atn/RuleStartState.h>
+#include <misc/Interval.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace c3 {
+
+namespace {
+
+constexpr size_t ValuesPerLine = 16;
+
+/**
+ * Writes a `constexpr` array definition, unless the values are empty (arrays
+ * cannot be). Unsigned values get a `U` suffix, as EOF is stored as the
+ * largest `std::size_t`, which does not fit a signed literal.
+ *
+ * @returns The expression initializing a span over the array.
+ */
+template <class T>
+std::string writeArray(
+    std::ostream& output, std::string_view type, std::string_view name, std::vector<T> const& values
+) {
+  if (values.empty()) {
+    return "{}";
+  }
+
+  output << "constexpr " << type << " " << name << "[] = {";
+  for (size_t i = 0; i < values.size(); ++i) {
+    output << ((i % ValuesPerLine == 0) ? "\n    " : " ") << values[i];
+    if constexpr (std::is_unsigned_v<T>) {
+      output << "U";
+    }
+    output << ",";
+  }
+  output << "\n};\n\n";
+
+  return std::string(name);
+}
+
+/** Writes aggregate records, one per line. */
+template <class T, class Format>
+std::string writeRecords(
+    std::ostream& output,
+    std::string_view type,
+    std::string_view name,
+    std::vector<T> const& records,
+    Format format
+) {
+  if (records.empty()) {
+    return "{}";
+  }
+
+  output << "constexpr " << type << " " << name << "[] = {\n";
+  for (const T& record : records) {
+    output << "    {";
+    format(record);
+    output << "},\n";
+  }
+  output << "};\n\n";
+
+  return std::string(name);
+}
+
+}  // namespace
+
+bool writeFollowSetsTables(
+    antlr4::Parser& parser,
+    std::string_view name,
+    std::vector<std::string> const& preferredRules,
+    std::ostream& header,
+    std::ostream& source
+) {
+  std::vector<size_t> preferred;
+  const std::vector<std::string>& ruleNames = parser.getRuleNames();
+  for (const std::string& rule : preferredRules) {
+    const auto iter = std::ranges::find(ruleNames, rule);
+    if (iter == ruleNames.end()) {
+      return false;
+    }
+    preferred.push_back(static_cast<size_t>(std::distance(ruleNames.begin(), iter)));
+  }
+
+  auto model = std::make_shared<const GrammarModel>(parser);
+  CodeCompletionCore completion(model, &parser);
+  completion.buildFollowSets(1);
+
+  const antlr4::atn::ATN& atn = model->atn();
+
+  std::vector<RuleFollowSetsRecord> rules;
+  std::vector<FollowSetRecord> sets;
+  std::vector<ptrdiff_t> intervals;
+  std::vector<size_t> paths;
+  std::vector<size_t> following;
+  std::vector<PredicateRecord> predicates;
+
+  // A fresh build has a single variant per rule.
+  const auto any = [](const FollowSetsHolder& /*holder*/) { return true; };
+  for (const antlr4::atn::RuleStartState* start : atn.ruleToStartState) {
+    const auto holder = model->followSets().find(start->stateNumber, any);
+
+    rules.push_back({
+        .stateNumber = start->stateNumber,
+        .isExhaustive = holder->isExhaustive,
+        .setOffset = sets.size(),
+        .setCount = holder->sets.size(),
+        .predicateOffset = predicates.size(),
+        .predicateCount = holder->predicates.size(),
+    });
+
+    for (const FollowSetWithPath& set : holder->sets) {
+      sets.push_back({
+          .intervalOffset = intervals.size() / 2,
+          .intervalCount = set.intervals.getIntervals().size(),
+          .pathOffset = paths.size(),
+          .pathLength = set.path.size(),
+          .followingOffset = following.size(),
+          .followingLength = set.following.size(),
+      });
+      for (const antlr4::misc::Interval& interval : set.intervals.getIntervals()) {
+        intervals.push_back(interval.a);
+        intervals.push_back(interval.b);
+      }
+      paths.insert(paths.end(), set.path.begin(), set.path.end());
+      following.insert(following.end(), set.following.begin(), set.following.end());
+    }
+
+    for (const auto& [slot, outcome] : holder->predicates) {
+      predicates.push_back({.slot = slot, .outcome = outcome});
+    }
+  }
+
+  header << "// Generated by antlr4-c3 from " << model->grammarName() << ". Do not edit.\n\n"
+         << "#pragma once\n\n"
+         << "#include <antlr4-c3/FollowSetsTables.hpp>\n\n"
+         << "namespace c3::tables {\n\n"
+         << "extern const FollowSetsTables " << name << ";\n\n"
+         << "}  // namespace c3::tables\n";
+
+  source << "// Generated by antlr4-c3 from " << model->grammarName() << ". Do not edit.\n\n"
+         << "#include \"" << name << ".hpp\"\n\n"
+         << "#include <cstddef>\n\n"
+         << "namespace c3::tables {\n\n"
+         << "namespace {\n\n";
+
+  const std::string rulesName =
+      writeRecords(source, "RuleFollowSetsRecord", "Rules", rules, [&](const auto& rule) {
+        source << rule.stateNumber << ", " << (rule.isExhaustive ? "true" : "false") << ", "
+               << rule.setOffset << ", " << rule.setCount << ", " << rule.predicateOffset << ", "
+               << rule.predicateCount;
+      });
+  const std::string setsName =
+      writeRecords(source, "FollowSetRecord", "Sets", sets, [&](const auto& set) {
+        source << set.intervalOffset << ", " << set.intervalCount << ", " << set.pathOffset
+               << ", " << set.pathLength << ", " << set.followingOffset << ", "
+               << set.followingLength;
+      });
+  const std::string intervalsName = writeArray(source, "std::ptrdiff_t", "Intervals", intervals);
+  const std::string pathsName = writeArray(source, "std::size_t", "Paths", paths);
+  const std::string followingName = writeArray(source, "std::size_t", "Following", following);
+  const std::string predicatesName =
+      writeRecords(source, "PredicateRecord", "Predicates", predicates, [&](const auto& entry) {
+        source << entry.slot << ", " << (entry.outcome ? "true" : "false");
+      });
+  const std::string preferredName = writeArray(source, "std::size_t", "PreferredRules", preferred);
+
+  source << "}  // namespace\n\n"
+         << "constinit const FollowSetsTables " << name << " = {\n"
+         << "    .grammarName = \"" << model->grammarName() << "\",\n"
+         << "    .stateCount = " << atn.states.size() << ",\n"
+         << "    .ruleCount = " << atn.ruleToStartState.size() << ",\n"
+         << "    .rules = " << rulesName << ",\n"
+         << "    .sets = " << setsName << ",\n"
+         << "    .intervals = " << intervalsName << ",\n"
+         << "    .paths = " << pathsName << ",\n"
+         << "    .following = " << followingName << ",\n"
+         << "    .predicates = " << predicatesName << ",\n"
+         << "    .preferredRules = " << preferredName << ",\n"
+         << "};\n\n"
+         << "}  // namespace c3::tables\n";
+
+  return true;
+}
+
+}  // namespace c3
@@ -0,0 +1,95 @@
+//
+//  FollowSetsTables.hpp
+//
+//  C++ port of antlr4-c3 (TypeScript) by Mike Lischke
+//  Licensed under the MIT License.
+//
+
+#pragma once
+
+#include <Parser.h>
+
+#include <cstddef>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace c3 {
+
+/** One follow set: ranges into the interval, path and following arrays. */
+struct FollowSetRecord {
+  size_t intervalOffset;
+  size_t intervalCount;
+  size_t pathOffset;
+  size_t pathLength;
+  size_t followingOffset;
+  size_t followingLength;
+};
+
+/** The follow sets of one rule, as a range into the set and predicate arrays. */
+struct RuleFollowSetsRecord {
+  size_t stateNumber;
+  bool isExhaustive;
+  size_t setOffset;
+  size_t setCount;
+  size_t predicateOffset;
+  size_t predicateCount;
+};
+
+/** A predicate outcome a rule's follow sets depend on. */
+struct PredicateRecord {
+  size_t slot;
+  bool outcome;
+};
+
+/**
+ * Precomputed follow sets of a grammar, as flat arrays which can be emitted
+ * as `constexpr` data and linked into a binary. See
+ * `writeFollowSetsTables` and the `antlr4c3_generate_follow_sets` CMake
+ * function, and `CodeCompletionCore::loadFollowSets` for their use.
+ */
+struct FollowSetsTables {
+  /** The grammar file name, ATN state and rule counts, to detect mismatches. */
+  std::string_view grammarName;
+  size_t stateCount = 0;
+  size_t ruleCount = 0;
+
+  std::span<const RuleFollowSetsRecord> rules;
+  std::span<const FollowSetRecord> sets;
+
+  /** Interval bounds, two entries (inclusive start and end) per interval. */
+  std::span<const ptrdiff_t> intervals;
+  std::span<const size_t> paths;
+  std::span<const size_t> following;
+  std::span<const PredicateRecord> predicates;
+
+  /** Rule indexes to prefer, if any were given at generation time. */
+  std::span<const size_t> preferredRules;
+};
+
+/**
+ * Determines the follow sets of all rules of the parser's grammar and writes
+ * them as C++ source: a header declaring a `c3::tables::<name>` variable of
+ * type `FollowSetsTables` and a source file defining it from `constexpr`
+ * arrays. Semantic predicates are evaluated through the parser.
+ *
+ * @param parser A parser of the grammar.
+ * @param name The name of the variable.
+ * @param preferredRules Names of rules to list in `preferredRules`.
+ * @param header Receives the header.
+ * @param source Receives the source file, which includes the header as
+ * `<name>.hpp`.
+ * @returns false if a preferred rule is not a rule of the grammar, in which
+ * case nothing is written.
+ */
+bool writeFollowSetsTables(
+    antlr4::Parser& parser,
+    std::string_view name,
+    std::vector<std::string> const& preferredRules,
+    std::ostream& header,
+    std::ostream& source
+);
+
+}  // namespace c3
@@ -0,0 +1,458 @@
+//
+//  GrammarAnalysis.cpp
+//
+//  C++ port of antlr4-c3 (TypeScript) by Mike Lischke
+//  Licensed under the MIT License.
+//
+
+#include "GrammarAnalysis.hpp"
+
+#include <Token.h>
+#include <atn/ATN.h>
+#include <atn/ATNState.h>
+#include <atn/ATNStateType.h>
+#include <atn/PrecedencePredicateTransition.h>
+#include <atn/PredicateTransition.h>
+#include <atn/RuleStartState.h>
+#include <atn/RuleTransition.h>
+#include <atn/Transition.h>
+#include <atn/TransitionType.h>
+#include <misc/IntervalSet.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace c3 {
+
+namespace {
+
+constexpr size_t Unreachable = std::numeric_limits<size_t>::max();
+
+/**
+ * @param transition A transition in a left-recursive rule.
+ * @returns The transition itself if it is a precedence predicate, the only
+ * transition of its target if it is an epsilon transition to a precedence
+ * predicate, otherwise nullptr.
+ */
+const antlr4::atn::PrecedencePredicateTransition* leadingPrecedencePredicate(
+    const antlr4::atn::Transition* transition
+) {
+  if (transition->getTransitionType() == antlr4::atn::TransitionType::EPSILON &&
+      transition->target->transitions.size() == 1) {
+    transition = transition->target->transitions[0].get();
+  }
+
+  if (transition->getTransitionType() != antlr4::atn::TransitionType::PRECEDENCE) {
+    return nullptr;
+  }
+  return dynamic_cast<const antlr4::atn::PrecedencePredicateTransition*>(transition);
+}
+
+}  // namespace
+
+const std::vector<PrecedenceAlternative>& OperatorTable::alternatives(size_t tokenType) const {
+  const auto iter = byToken.find(tokenType);
+  return (iter != byToken.end()) ? iter->second : others;
+}
+
+GrammarAnalysis::GrammarAnalysis(const antlr4::atn::ATN& atn) {
+  computeFirstSets(atn);
+  computeCallGraph(atn);
+  computeOperatorTables(atn);
+  computeFollowingTokens(atn);
+  collectPredicates(atn);
+}
+
+std::shared_ptr<const GrammarAnalysis> GrammarAnalysis::forATN(const antlr4::atn::ATN& atn) {
+  static std::mutex mutex;
+  static std::unordered_map<const antlr4::atn::ATN*, std::weak_ptr<const GrammarAnalysis>>
+      analyses;
+
+  const std::scoped_lock lock(mutex);
+
+  // Entries of freed analyses must go, as their ATN may be gone, too, and its
+  // address reused.
+  std::erase_if(analyses, [](const auto& item) { return item.second.expired(); });
+
+  std::weak_ptr<const GrammarAnalysis>& entry = analyses[&atn];
+  std::shared_ptr<const GrammarAnalysis> analysis = entry.lock();
+  if (analysis == nullptr) {
+    analysis = std::make_shared<const GrammarAnalysis>(atn);
+    entry = analysis;
+  }
+  return analysis;
+}
+
+const antlr4::misc::IntervalSet& GrammarAnalysis::firstSet(size_t stateNumber) const {
+  return first[stateNumber];
+}
+
+bool GrammarAnalysis::reachesRuleEnd(size_t stateNumber) const {
+  return reachesEnd[stateNumber];
+}
+
+bool GrammarAnalysis::canContinue(size_t stateNumber, size_t tokenType) const {
+  return reachesEnd[stateNumber] || first[stateNumber].contains(tokenType);
+}
+
+std::span<const size_t> GrammarAnalysis::followingTokens(size_t stateNumber) const {
+  const auto [offset, length] = following[stateNumber];
+  return std::span<const size_t>(tokenPool).subspan(offset, length);
+}
+
+const OperatorTable* GrammarAnalysis::operatorTable(size_t stateNumber) const {
+  const auto iter = operators.find(stateNumber);
+  return (iter != operators.end()) ? &iter->second : nullptr;
+}
+
+const std::vector<PredicateKey>& GrammarAnalysis::predicates() const {
+  return predicateList;
+}
+
+std::optional<size_t> GrammarAnalysis::predicateSlot(size_t ruleIndex, size_t predIndex) const {
+  const auto iter = predicateSlots.find({ruleIndex, predIndex});
+  if (iter == predicateSlots.end()) {
+    return std::nullopt;
+  }
+  return iter->second;
+}
+
+const antlr4::atn::PredicateTransition* GrammarAnalysis::predicateTransition(size_t slot) const {
+  return predicateTransitions[slot];
+}
+
+bool GrammarAnalysis::isRecursive(size_t ruleIndex) const {
+  return recursive[ruleIndex];
+}
+
+const std::vector<std::vector<size_t>>& GrammarAnalysis::ruleLevels() const {
+  return levels;
+}
+
+size_t GrammarAnalysis::bytes() const {
+  size_t result = first.capacity() * sizeof(antlr4::misc::IntervalSet);
+  for (const antlr4::misc::IntervalSet& set : first) {
+    result += set.getIntervals().capacity() * sizeof(antlr4::misc::Interval);
+  }
+  result += reachesEnd.capacity() / 8;
+  result += recursive.capacity() / 8 + levels.capacity() * sizeof(std::vector<size_t>);
+  for (const std::vector<size_t>& level : levels) {
+    result += level.capacity() * sizeof(size_t);
+  }
+  result += tokenPool.capacity() * sizeof(size_t);
+  result += following.capacity() * sizeof(std::pair<size_t, size_t>);
+  for (const auto& [state, table] : operators) {
+    result += sizeof(state) + sizeof(table);
+    result += table.others.capacity() * sizeof(PrecedenceAlternative);
+    for (const auto& [token, alternatives] : table.byToken) {
+      result += sizeof(token) + sizeof(alternatives) +
+                alternatives.capacity() * sizeof(PrecedenceAlternative);
+    }
+  }
+  result += predicateList.capacity() * sizeof(PredicateKey);
+  result += predicateTransitions.capacity() * sizeof(void*);
+  result += predicateSlots.size() * (sizeof(std::pair<size_t, size_t>) + sizeof(size_t));
+  return result;
+}
+
+/**
+ * Determines the FIRST set and the rule end reachability of every ATN state,
+ * by propagating them backwards over the transitions until nothing changes
+ * anymore. Both only grow, so comparing sizes detects changes.
+ */
+void GrammarAnalysis::computeFirstSets(const antlr4::atn::ATN& atn) {
+  first.assign(atn.states.size(), {});
+  reachesEnd.assign(atn.states.size(), false);
+
+  const auto allUserTokens = antlr4::misc::IntervalSet::of(
+      antlr4::Token::MIN_USER_TOKEN_TYPE, static_cast<ptrdiff_t>(atn.maxTokenType)
+  );
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+
+    // Transitions mostly lead to higher state numbers, so going backwards
+    // needs fewer rounds.
+    for (const antlr4::atn::ATNState* state : std::views::reverse(atn.states)) {
+      if (state == nullptr) {
+        continue;
+      }
+
+      const size_t number = state->stateNumber;
+      antlr4::misc::IntervalSet& set = first[number];
+      const size_t oldSize = set.size();
+      bool reaches = reachesEnd[number];
+
+      if (state->getStateType() == antlr4::atn::ATNStateType::RULE_STOP) {
+        reaches = true;
+      }
+
+      for (const antlr4::atn::ConstTransitionPtr& transition : state->transitions) {
+        const size_t target = transition->target->stateNumber;
+
+        switch (transition->getTransitionType()) {
+          case antlr4::atn::TransitionType::RULE: {
+            const auto* ruleTransition =
+                dynamic_cast<const antlr4::atn::RuleTransition*>(transition.get());
+            set.addAll(first[target]);
+            if (reachesEnd[target]) {
+              set.addAll(first[ruleTransition->followState->stateNumber]);
+              reaches = reaches || reachesEnd[ruleTransition->followState->stateNumber];
+            }
+            break;
+          }
+
+          case antlr4::atn::TransitionType::WILDCARD:
+            set.addAll(allUserTokens);
+            break;
+
+          case antlr4::atn::TransitionType::NOT_SET:
+            set.addAll(transition->label().complement(allUserTokens));
+            break;
+
+          default:
+            if (transition->isEpsilon()) {
+              set.addAll(first[target]);
+              reaches = reaches || reachesEnd[target];
+            } else {
+              set.addAll(transition->label());
+            }
+        }
+      }
+
+      if (set.size() != oldSize || reaches != reachesEnd[number]) {
+        reachesEnd[number] = reaches;
+        changed = true;
+      }
+    }
+  }
+}
+
+/**
+ * Builds the rule call graph from the rule transitions and determines its
+ * strongly connected components (Tarjan). Components are found callees
+ * first, which directly gives the level of each one.
+ */
+void GrammarAnalysis::computeCallGraph(const antlr4::atn::ATN& atn) {
+  const size_t ruleCount = atn.ruleToStartState.size();
+
+  std::vector<std::vector<size_t>> callees(ruleCount);
+  for (const antlr4::atn::ATNState* state : atn.states) {
+    if (state == nullptr) {
+      continue;
+    }
+    for (const antlr4::atn::ConstTransitionPtr& transition : state->transitions) {
+      if (transition->getTransitionType() == antlr4::atn::TransitionType::RULE) {
+        callees[state->ruleIndex].push_back(transition->target->ruleIndex);
+      }
+    }
+  }
+
+  recursive.assign(ruleCount, false);
+  levels.clear();
+
+  std::vector<size_t> index(ruleCount, Unreachable);
+  std::vector<size_t> lowLink(ruleCount, 0);
+  std::vector<size_t> component(ruleCount, Unreachable);
+  std::vector<size_t> componentLevel;
+  std::vector<size_t> stack;
+  std::vector<bool> onStack(ruleCount, false);
+  size_t counter = 0;
+
+  const auto connect = [&](const auto& self, size_t rule) -> void {
+    index[rule] = lowLink[rule] = counter++;
+    stack.push_back(rule);
+    onStack[rule] = true;
+
+    for (const size_t callee : callees[rule]) {
+      if (index[callee] == Unreachable) {
+        self(self, callee);
+        lowLink[rule] = std::min(lowLink[rule], lowLink[callee]);
+      } else if (onStack[callee]) {
+        lowLink[rule] = std::min(lowLink[rule], index[callee]);
+      }
+    }
+
+    if (lowLink[rule] != index[rule]) {
+      return;
+    }
+
+    std::vector<size_t> members;
+    size_t member = 0;
+    do {
+      member = stack.back();
+      stack.pop_back();
+      onStack[member] = false;
+      component[member] = componentLevel.size();
+      members.push_back(member);
+    } while (member != rule);
+
+    size_t level = 0;
+    for (const size_t entry : members) {
+      for (const size_t callee : callees[entry]) {
+        if (component[callee] == component[rule]) {
+          recursive[entry] = true;
+        } else {
+          level = std::max(level, componentLevel[component[callee]] + 1);
+        }
+      }
+    }
+    componentLevel.push_back(level);
+
+    if (levels.size() <= level) {
+      levels.resize(level + 1);
+    }
+    levels[level].insert(levels[level].end(), members.begin(), members.end());
+  };
+
+  for (size_t rule = 0; rule < ruleCount; ++rule) {
+    if (index[rule] == Unreachable) {
+      connect(connect, rule);
+    }
+  }
+
+  for (std::vector<size_t>& level : levels) {
+    std::ranges::sort(level);
+  }
+}
+
+/**
+ * Builds the operator tables of all left-recursive rules. ANTLR rewrites such
+ * rules into the primary alternatives, followed by a loop whose alternatives
+ * each start with a precedence predicate. The block of that loop is
+ * recognized by all its transitions leading to such a predicate.
+ */
+void GrammarAnalysis::computeOperatorTables(const antlr4::atn::ATN& atn) {
+  for (const antlr4::atn::ATNState* state : atn.states) {
+    if (state == nullptr || state->transitions.empty() ||
+        !atn.ruleToStartState[state->ruleIndex]->isLeftRecursiveRule) {
+      continue;
+    }
+
+    std::vector<PrecedenceAlternative> alternatives;
+    for (const antlr4::atn::ConstTransitionPtr& transition : state->transitions) {
+      const auto* predicate = leadingPrecedencePredicate(transition.get());
+      if (predicate == nullptr) {
+        break;
+      }
+      alternatives.push_back({
+          .precedence = predicate->getPrecedence(),
+          .target = predicate->target,
+      });
+    }
+
+    if (alternatives.size() != state->transitions.size()) {
+      continue;
+    }
+
+    OperatorTable table;
+    for (const PrecedenceAlternative& alternative : alternatives) {
+      if (reachesEnd[alternative.target->stateNumber]) {
+        table.others.push_back(alternative);
+      }
+    }
+
+    antlr4::misc::IntervalSet tokens;
+    for (const PrecedenceAlternative& alternative : alternatives) {
+      tokens.addAll(first[alternative.target->stateNumber]);
+    }
+
+    // Each entry keeps the ATN order of the alternatives, like the walk
+    // without the table.
+    for (const ptrdiff_t token : tokens.toList()) {
+      std::vector<PrecedenceAlternative>& entry = table.byToken[static_cast<size_t>(token)];
+      for (const PrecedenceAlternative& alternative : alternatives) {
+        const size_t number = alternative.target->stateNumber;
+        if (reachesEnd[number] || first[number].contains(static_cast<size_t>(token))) {
+          entry.push_back(alternative);
+        }
+      }
+    }
+
+    operators[state->stateNumber] = std::move(table);
+  }
+}
+
+/**
+ * Collects the following token sequence of every state. Equal sequences are
+ * stored only once in the shared pool.
+ */
+void GrammarAnalysis::computeFollowingTokens(const antlr4::atn::ATN& atn) {
+  following.assign(atn.states.size(), {0, 0});
+
+  std::map<std::vector<size_t>, size_t> interned;
+  for (const antlr4::atn::ATNState* start : atn.states) {
+    if (start == nullptr) {
+      continue;
+    }
+
+    std::vector<size_t> tokens;
+    std::vector<const antlr4::atn::ATNState*> pipeline = {start};
+    while (!pipeline.empty()) {
+      const antlr4::atn::ATNState* state = pipeline.back();
+      pipeline.pop_back();
+
+      for (const antlr4::atn::ConstTransitionPtr& outgoing : state->transitions) {
+        if (outgoing->getTransitionType() == antlr4::atn::TransitionType::ATOM) {
+          const auto list = outgoing->label();
+          if (list.size() == 1) {
+            tokens.push_back(static_cast<size_t>(list.get(0)));
+            pipeline.push_back(outgoing->target);
+          }
+        }
+      }
+    }
+
+    if (tokens.empty()) {
+      continue;
+    }
+
+    const auto [iter, inserted] = interned.try_emplace(tokens, tokenPool.size());
+    if (inserted) {
+      tokenPool.insert(tokenPool.end(), tokens.begin(), tokens.end());
+    }
+    following[start->stateNumber] = {iter->second, tokens.size()};
+  }
+}
+
+/**
+ * Lists the semantic predicates of all predicate transitions and assigns each
+ * distinct one a slot.
+ */
+void GrammarAnalysis::collectPredicates(const antlr4::atn::ATN& atn) {
+  for (const antlr4::atn::ATNState* state : atn.states) {
+    if (state == nullptr) {
+      continue;
+    }
+
+    for (const antlr4::atn::ConstTransitionPtr& transition : state->transitions) {
+      if (transition->getTransitionType() != antlr4::atn::TransitionType::PREDICATE) {
+        continue;
+      }
+
+      const auto* predicate =
+          dynamic_cast<const antlr4::atn::PredicateTransition*>(transition.get());
+      const PredicateKey key = {
+          .ruleIndex = predicate->getRuleIndex(),
+          .predIndex = predicate->getPredIndex(),
+      };
+      if (predicateSlots.try_emplace({key.ruleIndex, key.predIndex}, predicateList.size()).second) {
+        predicateList.push_back(key);
+        predicateTransitions.push_back(predicate);
+      }
+    }
+  }
+}
+
+}  // namespace c3
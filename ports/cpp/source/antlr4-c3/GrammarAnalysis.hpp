@@ -0,0 +1,195 @@
+//
+//  GrammarAnalysis.hpp
+//
+//  C++ port of antlr4-c3 (TypeScript) by Mike Lischke
+//  Licensed under the MIT License.
+//
+
+#pragma once
+
+#include <atn/ATN.h>
+#include <atn/ATNState.h>
+#include <atn/PredicateTransition.h>
+#include <misc/IntervalSet.h>
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace c3 {
+
+/**
+ * Identifies a semantic predicate of a grammar, as passed to
+ * `Recognizer::sempred`.
+ */
+struct PredicateKey {
+  size_t ruleIndex;
+  size_t predIndex;
+
+  friend bool operator==(const PredicateKey& lhs, const PredicateKey& rhs) = default;
+};
+
+/**
+ * One operator alternative of a left-recursive rule: the precedence its
+ * predicate requires and the state following that predicate.
+ */
+struct PrecedenceAlternative {
+  int precedence;
+  antlr4::atn::ATNState* target;
+};
+
+/**
+ * The operator alternatives of the loop ANTLR generates for a left-recursive
+ * rule, indexed by the tokens which can start them.
+ */
+struct OperatorTable {
+  std::unordered_map<size_t, std::vector<PrecedenceAlternative>> byToken;
+
+  /** Alternatives which can be passed without consuming a token. */
+  std::vector<PrecedenceAlternative> others;
+
+  /**
+   * @param tokenType The next input token.
+   * @returns The alternatives which can match the token or can be passed
+   * without consuming, in ATN order.
+   */
+  [[nodiscard]] const std::vector<PrecedenceAlternative>& alternatives(size_t tokenType) const;
+};
+
+/**
+ * Static tables derived from a parser ATN, computed once per grammar.
+ *
+ * All tables over-approximate the language: semantic and precedence
+ * predicates are assumed to hold, so a token which is not in a FIRST set can
+ * never be matched from that state, whatever the predicates evaluate to. This
+ * makes them safe for pruning the ATN walk.
+ */
+class GrammarAnalysis {
+public:
+  explicit GrammarAnalysis(const antlr4::atn::ATN& atn);
+
+  /**
+   * Returns the analysis of the given ATN, shared by everyone who holds it,
+   * computing it if nobody does. The analysis is freed with its last holder,
+   * e.g. when all models of the grammar are unloaded. Thread-safe.
+   *
+   * @param atn The parser ATN. Must outlive the analysis.
+   * @returns The shared analysis.
+   */
+  static std::shared_ptr<const GrammarAnalysis> forATN(const antlr4::atn::ATN& atn);
+
+  /**
+   * @param stateNumber The ATN state.
+   * @returns The tokens which can be the first one consumed from the given
+   * state, before its rule ends.
+   */
+  [[nodiscard]] const antlr4::misc::IntervalSet& firstSet(size_t stateNumber) const;
+
+  /**
+   * @param stateNumber The ATN state.
+   * @returns true if the end of the state's rule can be reached from it
+   * without consuming a token.
+   */
+  [[nodiscard]] bool reachesRuleEnd(size_t stateNumber) const;
+
+  /**
+   * Checks if a walk from the given state could consume the given token,
+   * or leave the rule without consuming anything (and let the caller consume
+   * it).
+   *
+   * @param stateNumber The ATN state.
+   * @param tokenType The next input token.
+   * @returns false if the walk from this state is certain to fail.
+   */
+  [[nodiscard]] bool canContinue(size_t stateNumber, size_t tokenType) const;
+
+  /**
+   * @param ruleIndex The rule to check.
+   * @returns true if the rule can invoke itself, directly or through other
+   * rules.
+   */
+  [[nodiscard]] bool isRecursive(size_t ruleIndex) const;
+
+  /**
+   * All rules, grouped by their position in the rule call graph: a rule only
+   * invokes rules of earlier groups or rules it is mutually recursive with,
+   * which are in the same group. Rules of one group can therefore be worked
+   * on in parallel once the earlier groups are done.
+   *
+   * @returns The rule indexes per group, leaf rules first.
+   */
+  [[nodiscard]] const std::vector<std::vector<size_t>>& ruleLevels() const;
+
+  /**
+   * The tokens which directly follow a state within its rule, as a fixed
+   * sequence: single token transitions only, without intermediate rule
+   * transitions. This is what a token candidate reached through a transition
+   * into the state can be completed with.
+   *
+   * @param stateNumber The ATN state.
+   * @returns The token sequence, in shared storage.
+   */
+  [[nodiscard]] std::span<const size_t> followingTokens(size_t stateNumber) const;
+
+  /**
+   * @param stateNumber The ATN state.
+   * @returns The operator table if the state is the operator loop block of a
+   * left-recursive rule, otherwise nullptr.
+   */
+  [[nodiscard]] const OperatorTable* operatorTable(size_t stateNumber) const;
+
+  /**
+   * @returns All semantic predicates of the grammar, each listed once, in ATN
+   * order.
+   */
+  [[nodiscard]] const std::vector<PredicateKey>& predicates() const;
+
+  /**
+   * @param ruleIndex The rule index of the predicate.
+   * @param predIndex The predicate index.
+   * @returns The position of the predicate in `predicates()`.
+   */
+  [[nodiscard]] std::optional<size_t> predicateSlot(size_t ruleIndex, size_t predIndex) const;
+
+  /**
+   * @param slot A position in `predicates()`.
+   * @returns A transition which carries the predicate.
+   */
+  [[nodiscard]] const antlr4::atn::PredicateTransition* predicateTransition(size_t slot) const;
+
+  /**
+   * @returns The approximate number of bytes held by the tables.
+   */
+  [[nodiscard]] size_t bytes() const;
+
+private:
+  std::vector<antlr4::misc::IntervalSet> first;
+  std::vector<bool> reachesEnd;
+  std::vector<bool> recursive;
+  std::vector<std::vector<size_t>> levels;
+  std::unordered_map<size_t, OperatorTable> operators;
+
+  /** Interned following token sequences, as (offset, length) in `tokenPool` per state. */
+  std::vector<size_t> tokenPool;
+  std::vector<std::pair<size_t, size_t>> following;
+  std::vector<PredicateKey> predicateList;
+  std::vector<const antlr4::atn::PredicateTransition*> predicateTransitions;
+  std::map<std::pair<size_t, size_t>, size_t> predicateSlots;
+
+  void computeFirstSets(const antlr4::atn::ATN& atn);
+
+  void computeCallGraph(const antlr4::atn::ATN& atn);
+
+  void computeOperatorTables(const antlr4::atn::ATN& atn);
+
+  void computeFollowingTokens(const antlr4::atn::ATN& atn);
+
+  void collectPredicates(const antlr4::atn::ATN& atn);
+};
+
+}  // namespace c3
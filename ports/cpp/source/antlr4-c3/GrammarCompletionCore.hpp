@@ -0,0 +1,154 @@
+//
+//  GrammarCompletionCore.hpp
+//
+//  C++ port of antlr4-c3 (TypeScript) by Mike Lischke
+//  Licensed under the MIT License.
+//
+
+#pragma once
+
+#include "CodeCompletionCore.hpp"
+#include "GrammarModel.hpp"
+#include "IndexSet.hpp"
+
+#include <Parser.h>
+
+#include <bitset>
+#include <concepts>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace c3 {
+
+/**
+ * The token and rule counts of a generated parser. Generated parsers only
+ * declare the individual token types and rule indexes, so the counts are
+ * provided by specializing this template with the highest of them, e.g.:
+ *
+ *   template <>
+ *   struct c3::GrammarTraits<MyParser> {
+ *     static constexpr size_t TokenCount = MyParser::WS + 1;
+ *     static constexpr size_t RuleCount = MyParser::RuleStatement + 1;
+ *   };
+ */
+template <class Grammar>
+struct GrammarTraits;
+
+template <class Grammar>
+concept GrammarWithTraits = std::derived_from<Grammar, antlr4::Parser> && requires {
+  { GrammarTraits<Grammar>::TokenCount } -> std::convertible_to<size_t>;
+  { GrammarTraits<Grammar>::RuleCount } -> std::convertible_to<size_t>;
+};
+
+/**
+ * A `CodeCompletionCore` for one generated parser type, whose token and rule
+ * counts are known at compile time. Token types and rule indexes passed as
+ * template arguments are checked against these counts, and sets of them are
+ * `std::bitset`s of fixed size, so testing candidates for membership needs
+ * no bounds checks or allocations. The walk itself is the same as that of the
+ * generic class, which remains the one to use for grammars loaded at runtime.
+ */
+template <GrammarWithTraits Grammar>
+class GrammarCompletionCore : public CodeCompletionCore {
+public:
+  /** The number of token types, including 0 (unused by ANTLR). */
+  static constexpr size_t TokenCount = GrammarTraits<Grammar>::TokenCount;
+
+  static constexpr size_t RuleCount = GrammarTraits<Grammar>::RuleCount;
+
+  using TokenSet = std::bitset<TokenCount>;
+  using RuleSet = std::bitset<RuleCount>;
+
+  /**
+   * @param parser The parser whose token stream is completed and which
+   * evaluates semantic predicates.
+   */
+  explicit GrammarCompletionCore(Grammar* parser) : CodeCompletionCore(parser) {
+  }
+
+  /**
+   * @param model The grammar model, which must have been created for
+   * `Grammar` (see `matches`).
+   * @param parser The parser, optional as for `CodeCompletionCore`.
+   */
+  explicit GrammarCompletionCore(
+      std::shared_ptr<const GrammarModel> model, Grammar* parser = nullptr
+  )
+      : CodeCompletionCore(std::move(model), parser) {
+  }
+
+  /**
+   * @param model A grammar model.
+   * @returns true if the model's ATN has the token and rule counts of `Grammar`.
+   */
+  [[nodiscard]] static bool matches(const GrammarModel& model) {
+    return model.atn().maxTokenType < TokenCount &&
+           model.atn().ruleToStartState.size() == RuleCount;
+  }
+
+  /** Adds the given token types to `ignoredTokens`. */
+  template <size_t... Tokens>
+  void ignore() {
+    static_assert(((Tokens < TokenCount) && ...), "Not a token type of the grammar");
+    (ignoredTokens.insert(Tokens), ...);
+  }
+
+  /** Adds the given rule indexes to `preferredRules`. */
+  template <size_t... Rules>
+  void prefer() {
+    static_assert(((Rules < RuleCount) && ...), "Not a rule index of the grammar");
+    (preferredRules.insert(Rules), ...);
+  }
+
+  /** Replaces `ignoredTokens` with the given set. */
+  void ignore(TokenSet const& tokens) {
+    ignoredTokens = toIndexSet(tokens);
+  }
+
+  /** Replaces `preferredRules` with the given set. */
+  void prefer(RuleSet const& rules) {
+    preferredRules = toIndexSet(rules);
+  }
+
+  /**
+   * @returns The token types of the candidates. EOF (`antlr4::Token::EOF`)
+   * has no bit in a `TokenSet` and is left out, so check
+   * `candidates.tokens.contains(antlr4::Token::EOF)` to know whether the
+   * input may end at the caret.
+   */
+  [[nodiscard]] static TokenSet tokenSet(CandidatesCollection const& candidates) {
+    TokenSet result;
+    for (const auto& [token, _] : candidates.tokens) {
+      if (token < TokenCount) {
+        result.set(token);
+      }
+    }
+    return result;
+  }
+
+  /** @returns The rule indexes of the candidates. */
+  [[nodiscard]] static RuleSet ruleSet(CandidatesCollection const& candidates) {
+    RuleSet result;
+    for (const auto& [rule, _] : candidates.rules) {
+      if (rule < RuleCount) {
+        result.set(rule);
+      }
+    }
+    return result;
+  }
+
+private:
+  template <size_t N>
+  static IndexSet toIndexSet(std::bitset<N> const& bits) {
+    IndexSet result;
+    for (size_t i = 0; i < N; ++i) {
+      if (bits.test(i)) {
+        result.insert(i);
+      }
+    }
+    return result;
+  }
+};
+
+}  // namespace c3
@@ -0,0 +1,313 @@
+//
+//  GrammarModel.cpp
+//
+//  C++ port of antlr4-c3 (TypeScript) by Mike Lischke
+//  Licensed under the MIT License.
+//
+
+#include "GrammarModel.hpp"
+
+#include "GrammarAnalysis.hpp"
+#include "Metrics.hpp"
+#include "VocabularyTrie.hpp"
+
+#include <Parser.h>
+#include <Vocabulary.h>
+#include <atn/ATN.h>
+#include <misc/IntervalSet.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <typeindex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace c3 {
+
+namespace {
+
+// Rough per-node bookkeeping costs of a hash map node: the next pointer and
+// the cached hash.
+constexpr size_t HashNodeOverhead = 2 * sizeof(void*);
+
+template <class T>
+size_t vectorBytes(std::vector<T> const& vector) {
+  return vector.capacity() * sizeof(T);
+}
+
+size_t intervalSetBytes(antlr4::misc::IntervalSet const& set) {
+  return vectorBytes(set.getIntervals());
+}
+
+}  // namespace
+
+/**
+ * Looks up follow sets for the given rule start state and marks them as
+ * recently used.
+ *
+ * `matches` can evaluate semantic predicates, i.e. run parser or user code,
+ * which may take long or even use the cache itself. So it is called without
+ * the lock held, on one variant at a time. A variant added or evicted
+ * concurrently can be missed, in which case the caller determines the follow
+ * sets again and `insert` returns the existing variant.
+ *
+ * @param stateNumber The number of the rule start state.
+ * @param matches Checks if a variant is valid for the current predicate
+ * outcomes.
+ * @returns The first matching cached follow sets or nullptr if there are none.
+ */
+std::shared_ptr<const FollowSetsHolder> FollowSetsCache::find(
+    size_t stateNumber, std::function<bool(const FollowSetsHolder&)> const& matches
+) const {
+  for (size_t index = 0;; ++index) {
+    std::shared_ptr<const FollowSetsHolder> holder;
+    {
+      const std::shared_lock lock(mutex);
+
+      const auto iter = entries.find(stateNumber);
+      if (iter == entries.end() || index >= iter->second.size()) {
+        return nullptr;
+      }
+      holder = iter->second[index]->holder;
+    }
+
+    if (matches(*holder)) {
+      markUsed(stateNumber, holder.get());
+      return holder;
+    }
+  }
+}
+
+/**
+ * Marks the given variant as recently used, if it is still cached.
+ *
+ * @param stateNumber The number of the rule start state.
+ * @param holder The variant.
+ */
+void FollowSetsCache::markUsed(size_t stateNumber, const FollowSetsHolder* holder) const {
+  const std::shared_lock lock(mutex);
+
+  const auto iter = entries.find(stateNumber);
+  if (iter == entries.end()) {
+    return;
+  }
+
+  for (const auto& entry : iter->second) {
+    if (entry->holder.get() == holder) {
+      entry->lastUse.store(++useCounter, std::memory_order_relaxed);
+      return;
+    }
+  }
+}
+
+/**
+ * Adds a variant of the follow sets for the given rule start state to the
+ * cache and evicts least recently used variants if that exceeds the given
+ * limit. If another request added a variant for the same predicate outcomes
+ * in the meantime, that one is kept and returned instead.
+ *
+ * @param stateNumber The number of the rule start state.
+ * @param holder The follow sets to store.
+ * @param limit The maximum number of bytes the cache may use, if any.
+ * @returns The stored follow sets.
+ */
+std::shared_ptr<const FollowSetsHolder> FollowSetsCache::insert(
+    size_t stateNumber, FollowSetsHolder holder, std::optional<size_t> limit
+) {
+  size_t bytes = sizeof(Entry) + sizeof(FollowSetsHolder) + HashNodeOverhead +
+                 vectorBytes(holder.sets) + intervalSetBytes(holder.combined) +
+                 vectorBytes(holder.predicates);
+  for (const FollowSetWithPath& set : holder.sets) {
+    bytes += intervalSetBytes(set.intervals) + vectorBytes(set.path) + vectorBytes(set.following);
+  }
+
+  const std::unique_lock lock(mutex);
+
+  std::vector<std::unique_ptr<Entry>>& variants = entries[stateNumber];
+  for (const auto& entry : variants) {
+    if (entry->holder->predicates == holder.predicates) {
+      entry->lastUse.store(++useCounter, std::memory_order_relaxed);
+      return entry->holder;
+    }
+  }
+
+  auto entry = std::make_unique<Entry>();
+  entry->holder = std::make_shared<const FollowSetsHolder>(std::move(holder));
+  entry->bytes = bytes;
+  entry->lastUse.store(++useCounter, std::memory_order_relaxed);
+
+  auto shared = entry->holder;
+  variants.push_back(std::move(entry));
+  ++entryCount;
+  totalBytes += bytes;
+
+  if (limit.has_value()) {
+    evict(*limit, shared.get());
+  }
+
+  return shared;
+}
+
+size_t FollowSetsCache::bytes() const {
+  const std::shared_lock lock(mutex);
+  return totalBytes;
+}
+
+size_t FollowSetsCache::size() const {
+  const std::shared_lock lock(mutex);
+  return entryCount;
+}
+
+size_t FollowSetsCache::evictions() const {
+  const std::shared_lock lock(mutex);
+  return evictionCount;
+}
+
+/**
+ * Removes the least recently used variants until the cache fits into the
+ * given limit. The variant `keep` is never removed. Must be called with the
+ * lock held exclusively.
+ *
+ * @param limit The maximum number of bytes the cache may use.
+ * @param keep The follow sets which must survive.
+ */
+void FollowSetsCache::evict(size_t limit, const FollowSetsHolder* keep) {
+  while (totalBytes > limit && entryCount > 1) {
+    std::vector<std::unique_ptr<Entry>>* victimList = nullptr;
+    size_t victimIndex = 0;
+    size_t oldestUse = std::numeric_limits<size_t>::max();
+    for (auto& [_, variants] : entries) {
+      for (size_t index = 0; index < variants.size(); ++index) {
+        const size_t lastUse = variants[index]->lastUse.load(std::memory_order_relaxed);
+        if (variants[index]->holder.get() != keep && lastUse < oldestUse) {
+          oldestUse = lastUse;
+          victimList = &variants;
+          victimIndex = index;
+        }
+      }
+    }
+
+    totalBytes -= (*victimList)[victimIndex]->bytes;
+    victimList->erase(std::next(victimList->begin(), static_cast<ptrdiff_t>(victimIndex)));
+    --entryCount;
+    ++evictionCount;
+  }
+
+  std::erase_if(entries, [](const auto& item) { return item.second.empty(); });
+}
+
+GrammarModel::GrammarModel(const antlr4::Parser& parser, CompletionOptions options)
+    : GrammarModel(
+          parser.getATN(),
+          parser.getVocabulary(),
+          parser.getRuleNames(),
+          parser.getGrammarFileName(),
+          std::move(options)
+      ) {
+}
+
+GrammarModel::GrammarModel(
+    const antlr4::atn::ATN& atn,
+    const antlr4::dfa::Vocabulary& vocabulary,
+    std::vector<std::string> ruleNames,
+    std::string grammarName,
+    CompletionOptions options
+)
+    : atnPointer(&atn)
+    , vocabularyPointer(&vocabulary)
+    , names(std::move(ruleNames))
+    , grammarFileName(std::move(grammarName))
+    , defaults(std::move(options))
+    , grammarAnalysis(GrammarAnalysis::forATN(atn))
+    , trie(VocabularyTrie::forVocabulary(vocabulary, atn.maxTokenType))
+    , grammarMetrics(&MetricsRegistry::instance().grammar(grammarFileName)) {
+}
+
+std::shared_ptr<const GrammarModel> GrammarModel::forParser(const antlr4::Parser& parser) {
+  static std::mutex mutex;
+  static std::unordered_map<std::type_index, std::shared_ptr<const GrammarModel>> models;
+
+  const std::scoped_lock lock(mutex);
+
+  std::shared_ptr<const GrammarModel>& model = models[typeid(parser)];
+  if (model == nullptr) {
+    model = std::make_shared<const GrammarModel>(parser);
+  }
+  return model;
+}
+
+std::shared_ptr<const GrammarModel> GrammarModel::forATN(
+    const antlr4::atn::ATN& atn,
+    const antlr4::dfa::Vocabulary& vocabulary,
+    std::vector<std::string> const& ruleNames,
+    std::string const& grammarName
+) {
+  using Key = std::pair<const antlr4::atn::ATN*, const antlr4::dfa::Vocabulary*>;
+
+  static std::mutex mutex;
+  static std::map<Key, std::shared_ptr<const GrammarModel>> models;
+
+  const std::scoped_lock lock(mutex);
+
+  std::shared_ptr<const GrammarModel>& model = models[{&atn, &vocabulary}];
+  if (model == nullptr) {
+    model = std::make_shared<const GrammarModel>(atn, vocabulary, ruleNames, grammarName);
+  }
+  return model;
+}
+
+const antlr4::atn::ATN& GrammarModel::atn() const {
+  return *atnPointer;
+}
+
+const antlr4::dfa::Vocabulary& GrammarModel::vocabulary() const {
+  return *vocabularyPointer;
+}
+
+const std::vector<std::string>& GrammarModel::ruleNames() const {
+  return names;
+}
+
+const std::string& GrammarModel::grammarName() const {
+  return grammarFileName;
+}
+
+const CompletionOptions& GrammarModel::options() const {
+  return defaults;
+}
+
+const GrammarAnalysis& GrammarModel::analysis() const {
+  return *grammarAnalysis;
+}
+
+const VocabularyTrie& GrammarModel::vocabularyTrie() const {
+  return *trie;
+}
+
+GrammarMetrics& GrammarModel::metrics() const {
+  return *grammarMetrics;
+}
+
+FollowSetsCache& GrammarModel::followSets() const {
+  return cache;
+}
+
+size_t GrammarModel::bytes() const {
+  size_t result = sizeof(GrammarModel) + vectorBytes(names) + grammarFileName.capacity();
+  for (const std::string& name : names) {
+    result += name.capacity();
+  }
+  return result + grammarAnalysis->bytes() + trie->bytes() + cache.bytes();
+}
+
+}  // namespace c3
@@ -0,0 +1,261 @@
+//
+//  GrammarModel.hpp
+//
+//  C++ port of antlr4-c3 (TypeScript) by Mike Lischke
+//  Licensed under the MIT License.
+//
+
+#pragma once
+
+#include "GrammarAnalysis.hpp"
+#include "IndexSet.hpp"
+
+#include <Parser.h>
+#include <Vocabulary.h>
+#include <atn/ATN.h>
+#include <misc/IntervalSet.h>
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace c3 {
+
+class GrammarMetrics;
+class VocabularyTrie;
+
+/**
+ * Evaluates the given semantic predicates at once and returns their outcomes,
+ * in the same order.
+ */
+using PredicateEvaluator = std::function<std::vector<bool>(std::span<const PredicateKey>)>;
+
+/**
+ * A record for a follow set along with the path at which this set was found.
+ * If there is only a single symbol in the interval set then we also collect and
+ * store tokens which follow this symbol directly in its rule (i.e. there is no
+ * intermediate rule transition). Only single label transitions are considered.
+ * This is useful if you have a chain of tokens which can be suggested as a
+ * whole, because there is a fixed sequence in the grammar.
+ */
+struct FollowSetWithPath {
+  antlr4::misc::IntervalSet intervals;
+  std::vector<size_t> path;
+  std::vector<size_t> following;
+
+  friend bool operator==(const FollowSetWithPath& lhs, const FollowSetWithPath& rhs) = default;
+};
+
+/**
+ * A list of follow sets (for a given state number) + all of them combined for
+ * quick hit tests + whether they are exhaustive (false if subsequent
+ * yet-unprocessed rules could add further tokens to the follow set, true
+ * otherwise). This data is static in nature (because the used ATN states are
+ * part of a static struct: the ATN). Hence it can be shared between all
+ * requests for the same grammar.
+ */
+struct FollowSetsHolder {
+  std::vector<FollowSetWithPath> sets;
+  antlr4::misc::IntervalSet combined;
+  bool isExhaustive;
+
+  /**
+   * The semantic predicates (by slot) consulted while determining the sets,
+   * with their outcomes. The sets are valid whenever these predicates
+   * evaluate the same way again.
+   */
+  std::vector<std::pair<size_t, bool>> predicates;
+
+  friend bool operator==(const FollowSetsHolder& lhs, const FollowSetsHolder& rhs) = default;
+};
+
+/**
+ * The follow sets of one grammar, keyed by rule start state number. Follow
+ * sets which depend on semantic predicates can have several variants per
+ * state, one for each combination of predicate outcomes seen so far. The
+ * cache can be bounded by a byte limit, in which case the least recently
+ * used variants are evicted first. Entries are handed out as shared
+ * pointers, so an eviction never invalidates follow sets which are still in
+ * use by a walk.
+ *
+ * All members are thread-safe. Lookups only take a shared lock, so
+ * concurrent requests block each other only while a new variant is added.
+ */
+class FollowSetsCache {
+public:
+  std::shared_ptr<const FollowSetsHolder> find(
+      size_t stateNumber, std::function<bool(const FollowSetsHolder&)> const& matches
+  ) const;
+
+  std::shared_ptr<const FollowSetsHolder> insert(
+      size_t stateNumber, FollowSetsHolder holder, std::optional<size_t> limit
+  );
+
+  [[nodiscard]] size_t bytes() const;
+
+  [[nodiscard]] size_t size() const;
+
+  [[nodiscard]] size_t evictions() const;
+
+private:
+  struct Entry {
+    std::shared_ptr<const FollowSetsHolder> holder;
+    size_t bytes = 0;
+    mutable std::atomic<size_t> lastUse = 0;
+  };
+
+  mutable std::shared_mutex mutex;
+  std::unordered_map<size_t, std::vector<std::unique_ptr<Entry>>> entries;
+  size_t entryCount = 0;
+  size_t totalBytes = 0;
+  mutable std::atomic<size_t> useCounter = 0;
+  size_t evictionCount = 0;
+
+  void markUsed(size_t stateNumber, const FollowSetsHolder* holder) const;
+
+  void evict(size_t limit, const FollowSetsHolder* keep);
+};
+
+/**
+ * Defaults for the tailoring fields of every `CodeCompletionCore` created
+ * from a model, and the limits of the model itself.
+ */
+struct CompletionOptions {
+  /** Tokens which should not appear in the candidates set. */
+  IndexSet ignoredTokens;
+
+  /** Rules which replace any candidate token they contain. */
+  IndexSet preferredRules;
+
+  /** Translate preferred rules top-down instead of bottom-up. */
+  bool translateRulesTopDown = false;
+
+  /**
+   * If set, the maximum number of bytes the model's follow sets cache may
+   * occupy. The cache is shared by all requests on the model, so the limit
+   * is one of the model, too. Least recently used entries are evicted when a
+   * new entry pushes the cache over this limit. The entry just added is
+   * always kept, even if it alone exceeds the limit.
+   */
+  std::optional<size_t> followSetsCacheLimit = std::nullopt;
+
+  /** Evaluates the semantic predicates, needed if no parser is available. */
+  PredicateEvaluator predicateEvaluator = {};
+};
+
+/**
+ * Everything about a grammar which does not change between completion
+ * requests: the ATN, vocabulary and rule names, the default configuration,
+ * the static grammar analysis and the follow sets cache.
+ *
+ * A model is immutable, apart from its internally synchronized follow sets
+ * cache, so one instance can serve any number of concurrent requests. Each
+ * request runs in its own `CodeCompletionCore`, which only holds per-request
+ * state and can be reused for any number of sequential requests.
+ */
+class GrammarModel {
+public:
+  /**
+   * Takes the grammar data from the given parser. The parser's ATN and
+   * vocabulary must outlive the model, which is the case for generated
+   * parsers.
+   *
+   * @param parser A parser of the grammar.
+   * @param options The defaults for completions from this model.
+   */
+  explicit GrammarModel(const antlr4::Parser& parser, CompletionOptions options = {});
+
+  /**
+   * Creates a model from the grammar data alone, so no parser is needed.
+   *
+   * @param atn The parser ATN. Must outlive the model.
+   * @param vocabulary The parser vocabulary. Must outlive the model.
+   * @param ruleNames The parser rule names.
+   * @param grammarName The name under which metrics are recorded.
+   * @param options The defaults for completions from this model.
+   */
+  GrammarModel(
+      const antlr4::atn::ATN& atn,
+      const antlr4::dfa::Vocabulary& vocabulary,
+      std::vector<std::string> ruleNames,
+      std::string grammarName = {},
+      CompletionOptions options = {}
+  );
+
+  /**
+   * Returns a model for the parser's grammar, shared by all
+   * `CodeCompletionCore` instances constructed from a parser of the same type,
+   * on any thread. Thread-safe.
+   *
+   * @param parser A parser of the grammar.
+   * @returns The shared model.
+   */
+  static std::shared_ptr<const GrammarModel> forParser(const antlr4::Parser& parser);
+
+  /**
+   * Returns a model for the given grammar data, shared by all
+   * `CodeCompletionCore` instances constructed from the same ATN and
+   * vocabulary, on any thread. Thread-safe.
+   *
+   * @param atn The parser ATN. Must outlive the model.
+   * @param vocabulary The parser vocabulary. Must outlive the model.
+   * @param ruleNames The parser rule names.
+   * @param grammarName The name under which metrics are recorded. Only used
+   * when the model is created.
+   * @returns The shared model.
+   */
+  static std::shared_ptr<const GrammarModel> forATN(
+      const antlr4::atn::ATN& atn,
+      const antlr4::dfa::Vocabulary& vocabulary,
+      std::vector<std::string> const& ruleNames,
+      std::string const& grammarName = {}
+  );
+
+  [[nodiscard]] const antlr4::atn::ATN& atn() const;
+
+  [[nodiscard]] const antlr4::dfa::Vocabulary& vocabulary() const;
+
+  [[nodiscard]] const std::vector<std::string>& ruleNames() const;
+
+  [[nodiscard]] const std::string& grammarName() const;
+
+  [[nodiscard]] const CompletionOptions& options() const;
+
+  [[nodiscard]] const GrammarAnalysis& analysis() const;
+
+  [[nodiscard]] const VocabularyTrie& vocabularyTrie() const;
+
+  /** @returns The cumulative metrics of the grammar in the process-wide registry. */
+  [[nodiscard]] GrammarMetrics& metrics() const;
+
+  [[nodiscard]] FollowSetsCache& followSets() const;
+
+  /**
+   * @returns The approximate number of bytes held by the model, including its
+   * follow sets cache, grammar analysis and vocabulary trie. The latter two
+   * are shared by all loaded models of the same grammar, and counted for each
+   * of them.
+   */
+  [[nodiscard]] size_t bytes() const;
+
+private:
+  const antlr4::atn::ATN* atnPointer;
+  const antlr4::dfa::Vocabulary* vocabularyPointer;
+  std::vector<std::string> names;
+  std::string grammarFileName;
+  CompletionOptions defaults;
+  std::shared_ptr<const GrammarAnalysis> grammarAnalysis;
+  std::shared_ptr<const VocabularyTrie> trie;
+  GrammarMetrics* grammarMetrics;
+  mutable FollowSetsCache cache;
+};
+
+}  // namespace c3
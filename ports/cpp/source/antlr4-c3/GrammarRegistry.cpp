@@ -0,0 +1,148 @@
+//
+//  GrammarRegistry.cpp
+//
+//  C++ port of antlr4-c3 (TypeScript) by Mike Lischke
+//  Licensed under the MIT License.
+//
+
+#include "GrammarRegistry.hpp"
+
+#include "GrammarModel.hpp"
+
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace c3 {
+
+GrammarRegistry::GrammarRegistry(std::optional<size_t> memoryLimit) : limit(memoryLimit) {
+}
+
+void GrammarRegistry::add(std::string const& name, Loader loader) {
+  const std::scoped_lock lock(mutex);
+
+  grammars[name] = {.loader = std::move(loader), .model = nullptr, .lastUse = 0};
+}
+
+std::shared_ptr<const GrammarModel> GrammarRegistry::model(std::string_view name) {
+  Loader loader;
+  {
+    const std::scoped_lock lock(mutex);
+
+    const auto iter = grammars.find(name);
+    if (iter == grammars.end()) {
+      return nullptr;
+    }
+
+    iter->second.lastUse = ++useCounter;
+    if (iter->second.model != nullptr) {
+      return iter->second.model;
+    }
+    loader = iter->second.loader;
+  }
+
+  // Loading computes the grammar analysis, which can take a while. Other
+  // grammars stay available meanwhile.
+  std::shared_ptr<const GrammarModel> loaded = loader();
+
+  const std::scoped_lock lock(mutex);
+
+  const auto iter = grammars.find(name);
+  if (iter == grammars.end()) {
+    return loaded;
+  }
+
+  // Another thread may have loaded the grammar in the meantime.
+  if (iter->second.model == nullptr) {
+    iter->second.model = std::move(loaded);
+  }
+  evict(&iter->second);
+
+  return iter->second.model;
+}
+
+bool GrammarRegistry::isLoaded(std::string_view name) const {
+  const std::scoped_lock lock(mutex);
+
+  const auto iter = grammars.find(name);
+  return iter != grammars.end() && iter->second.model != nullptr;
+}
+
+std::vector<std::string> GrammarRegistry::names() const {
+  const std::scoped_lock lock(mutex);
+
+  std::vector<std::string> result;
+  result.reserve(grammars.size());
+  for (const auto& [name, _] : grammars) {
+    result.push_back(name);
+  }
+  return result;
+}
+
+size_t GrammarRegistry::bytes() const {
+  const std::scoped_lock lock(mutex);
+  return loadedBytes();
+}
+
+size_t GrammarRegistry::evictions() const {
+  const std::scoped_lock lock(mutex);
+  return evictionCount;
+}
+
+void GrammarRegistry::trim() {
+  const std::scoped_lock lock(mutex);
+  evict(nullptr);
+}
+
+/**
+ * @returns The bytes held by all loaded models. Must be called with the lock
+ * held.
+ */
+size_t GrammarRegistry::loadedBytes() const {
+  size_t result = 0;
+  for (const auto& [_, entry] : grammars) {
+    if (entry.model != nullptr) {
+      result += entry.model->bytes();
+    }
+  }
+  return result;
+}
+
+/**
+ * Unloads the least recently used grammars until the loaded models fit into
+ * the memory limit. Must be called with the lock held.
+ *
+ * @param keep A grammar which must stay loaded, if any.
+ */
+void GrammarRegistry::evict(const Entry* keep) {
+  if (!limit.has_value()) {
+    return;
+  }
+
+  // Caches of loaded models grow concurrently, so sum them up afresh each time.
+  while (loadedBytes() > *limit) {
+    Entry* victim = nullptr;
+    size_t oldestUse = std::numeric_limits<size_t>::max();
+    for (auto& [_, entry] : grammars) {
+      if (&entry != keep && entry.model != nullptr && entry.lastUse < oldestUse) {
+        oldestUse = entry.lastUse;
+        victim = &entry;
+      }
+    }
+
+    if (victim == nullptr) {
+      break;
+    }
+
+    victim->model = nullptr;
+    ++evictionCount;
+  }
+}
+
+}  // namespace c3
@@ -0,0 +1,114 @@
+//
+//  GrammarRegistry.hpp
+//
+//  C++ port of antlr4-c3 (TypeScript) by Mike Lischke
+//  Licensed under the MIT License.
+//
+
+#pragma once
+
+#include "GrammarModel.hpp"
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace c3 {
+
+/**
+ * Owns the models of any number of grammars, keyed by name, and keeps their
+ * combined memory within one budget.
+ *
+ * Models are created lazily by a loader on first use. When the models
+ * together exceed the memory limit, whole grammars are unloaded, least
+ * recently used first, and loaded again on their next use. Requests still
+ * running on an unloaded model keep it alive until they finish. The grammar
+ * analysis and vocabulary trie are shared by all models of the same grammar
+ * (e.g. with different options) and freed with the last of them. Each model
+ * counts them in its size, so several models of one grammar are
+ * overestimated.
+ *
+ * The memory limit is only enforced when a grammar is loaded and on `trim`.
+ * Follow sets caches grow while requests run, so in between the loaded models
+ * can exceed the limit. To bound that growth, give the models a
+ * `CompletionOptions::followSetsCacheLimit` in their loaders.
+ *
+ * All members are thread-safe. Looking up a model takes a short lock, so it
+ * should be done once per request, not per ATN state.
+ */
+class GrammarRegistry {
+public:
+  /** Creates the model of a grammar. Called without the registry lock held. */
+  using Loader = std::function<std::shared_ptr<const GrammarModel>()>;
+
+  /**
+   * @param memoryLimit If set, the maximum number of bytes all loaded models
+   * may occupy together, checked when a grammar is loaded and on `trim`.
+   */
+  explicit GrammarRegistry(std::optional<size_t> memoryLimit = std::nullopt);
+
+  /**
+   * Registers a grammar. Replaces (and unloads) a grammar of the same name.
+   *
+   * @param name The name under which the grammar is looked up.
+   * @param loader Creates the model when it is first needed.
+   */
+  void add(std::string const& name, Loader loader);
+
+  /**
+   * Returns the model of the given grammar, loading it if needed, and marks
+   * it as recently used. Loading may unload other grammars to stay within the
+   * memory limit.
+   *
+   * @param name The grammar name.
+   * @returns The model, or nullptr if no grammar of that name was added.
+   */
+  std::shared_ptr<const GrammarModel> model(std::string_view name);
+
+  /**
+   * @param name The grammar name.
+   * @returns true if the grammar's model is currently loaded.
+   */
+  [[nodiscard]] bool isLoaded(std::string_view name) const;
+
+  /** @returns The names of all added grammars, sorted. */
+  [[nodiscard]] std::vector<std::string> names() const;
+
+  /** @returns The approximate number of bytes held by all loaded models. */
+  [[nodiscard]] size_t bytes() const;
+
+  /** @returns The number of grammars unloaded so far to honor the memory limit. */
+  [[nodiscard]] size_t evictions() const;
+
+  /**
+   * Unloads least recently used grammars until the loaded models fit into
+   * the memory limit again. Follow sets caches grow while requests run, so
+   * call this periodically if grammars are not looked up frequently.
+   */
+  void trim();
+
+private:
+  struct Entry {
+    Loader loader;
+    std::shared_ptr<const GrammarModel> model;
+    size_t lastUse = 0;
+  };
+
+  mutable std::mutex mutex;
+  std::map<std::string, Entry, std::less<>> grammars;
+  std::optional<size_t> limit;
+  size_t useCounter = 0;
+  size_t evictionCount = 0;
+
+  size_t loadedBytes() const;
+
+  void evict(const Entry* keep);
+};
+
+}  // namespace c3
@@ -0,0 +1,233 @@
+//
+//  IndexSet.hpp
+//
+//  C++ port of antlr4-c3 (TypeScript) by Mike Lischke
+//  Licensed under the MIT License.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <ranges>
+#include <utility>
+#include <vector>
+
+namespace c3 {
+
+/**
+ * A set of small non-negative integers (token types, rule indexes), stored as
+ * a dense bitset which grows with the largest element. Membership tests need
+ * neither hashing nor allocation. Indexes from `DenseLimit` on, like
+ * `Token::EOF` (the largest `size_t`), are kept in a sorted list instead, so
+ * they do not blow up the bitset.
+ *
+ * The members mirror those of `std::unordered_set<size_t>`, which this class
+ * replaces in the public fields of `CodeCompletionCore`, so existing code
+ * using them keeps compiling.
+ */
+class IndexSet {
+public:
+  /** Indexes below this value are stored in the bitset. */
+  static constexpr size_t DenseLimit = size_t{1} << 16;
+
+  class Iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = size_t;
+    using difference_type = std::ptrdiff_t;
+
+    Iterator() = default;
+
+    Iterator(const IndexSet* set, size_t index, size_t position)
+        : set(set), index(index), position(position) {
+      skipUnset();
+    }
+
+    size_t operator*() const {
+      return (index < set->denseEnd()) ? index : set->sparse[position];
+    }
+
+    Iterator& operator++() {
+      if (index < set->denseEnd()) {
+        ++index;
+        skipUnset();
+      } else {
+        ++position;
+      }
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      Iterator result = *this;
+      ++*this;
+      return result;
+    }
+
+    friend bool operator==(const Iterator& lhs, const Iterator& rhs) {
+      return lhs.index == rhs.index && lhs.position == rhs.position;
+    }
+
+  private:
+    const IndexSet* set = nullptr;
+
+    /** The position in the bitset, or its end once the sparse indexes follow. */
+    size_t index = 0;
+
+    /** The position in the sparse indexes. */
+    size_t position = 0;
+
+    void skipUnset() {
+      const size_t limit = set->denseEnd();
+      while (index < limit && !set->contains(index)) {
+        ++index;
+      }
+    }
+  };
+
+  using value_type = size_t;
+  using size_type = size_t;
+  using iterator = Iterator;
+  using const_iterator = Iterator;
+
+  IndexSet() = default;
+
+  IndexSet(std::initializer_list<size_t> indexes) {
+    for (const size_t index : indexes) {
+      insert(index);
+    }
+  }
+
+  template <std::ranges::input_range Range>
+    requires std::convertible_to<std::ranges::range_value_t<Range>, size_t>
+  explicit IndexSet(Range const& indexes) {
+    for (const auto index : indexes) {
+      insert(static_cast<size_t>(index));
+    }
+  }
+
+  /** @returns The position of the index and whether it was inserted. */
+  std::pair<Iterator, bool> insert(size_t index) {
+    if (index >= DenseLimit) {
+      const auto iter = std::ranges::lower_bound(sparse, index);
+      const auto position = static_cast<size_t>(std::distance(sparse.begin(), iter));
+      if (iter != sparse.end() && *iter == index) {
+        return {Iterator(this, denseEnd(), position), false};
+      }
+      sparse.insert(iter, index);
+      ++elementCount;
+      return {Iterator(this, denseEnd(), position), true};
+    }
+
+    const size_t word = index / WordBits;
+    if (word >= words.size()) {
+      words.resize(word + 1, 0);
+    }
+    if ((words[word] & bit(index)) != 0) {
+      return {Iterator(this, index, 0), false};
+    }
+    words[word] |= bit(index);
+    ++elementCount;
+    return {Iterator(this, index, 0), true};
+  }
+
+  std::pair<Iterator, bool> emplace(size_t index) {
+    return insert(index);
+  }
+
+  /** @returns The number of removed indexes, 0 or 1. */
+  size_t erase(size_t index) {
+    if (!contains(index)) {
+      return 0;
+    }
+
+    if (index >= DenseLimit) {
+      sparse.erase(std::ranges::lower_bound(sparse, index));
+    } else {
+      words[index / WordBits] &= ~bit(index);
+    }
+    --elementCount;
+    return 1;
+  }
+
+  [[nodiscard]] bool contains(size_t index) const {
+    if (index >= DenseLimit) {
+      return std::ranges::binary_search(sparse, index);
+    }
+
+    const size_t word = index / WordBits;
+    return word < words.size() && (words[word] & bit(index)) != 0;
+  }
+
+  [[nodiscard]] size_t count(size_t index) const {
+    return contains(index) ? 1 : 0;
+  }
+
+  /** @returns The position of the index, or `end()` if it is not in the set. */
+  [[nodiscard]] Iterator find(size_t index) const {
+    if (!contains(index)) {
+      return end();
+    }
+
+    if (index >= DenseLimit) {
+      const auto iter = std::ranges::lower_bound(sparse, index);
+      return {this, denseEnd(), static_cast<size_t>(std::distance(sparse.begin(), iter))};
+    }
+    return {this, index, 0};
+  }
+
+  [[nodiscard]] bool empty() const {
+    return elementCount == 0;
+  }
+
+  [[nodiscard]] size_t size() const {
+    return elementCount;
+  }
+
+  void clear() {
+    words.clear();
+    sparse.clear();
+    elementCount = 0;
+  }
+
+  [[nodiscard]] Iterator begin() const {
+    return {this, 0, 0};
+  }
+
+  [[nodiscard]] Iterator end() const {
+    return {this, denseEnd(), sparse.size()};
+  }
+
+  /** @returns The number of bytes held by the bitset and the sparse indexes. */
+  [[nodiscard]] size_t bytes() const {
+    return words.capacity() * sizeof(uint64_t) + sparse.capacity() * sizeof(size_t);
+  }
+
+  friend bool operator==(const IndexSet& lhs, const IndexSet& rhs) {
+    return std::ranges::equal(lhs, rhs);
+  }
+
+private:
+  static constexpr size_t WordBits = 64;
+
+  std::vector<uint64_t> words;
+
+  /** The indexes from `DenseLimit` on, ascending. */
+  std::vector<size_t> sparse;
+
+  size_t elementCount = 0;
+
+  static uint64_t bit(size_t index) {
+    return uint64_t{1} << (index % WordBits);
+  }
+
+  [[nodiscard]] size_t denseEnd() const {
+    return words.size() * WordBits;
+  }
+};
+
+}  // namespace c3
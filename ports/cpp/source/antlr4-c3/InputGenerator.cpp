@@ -0,0 +1,351 @@
+//
+//  InputGenerator.cpp
+//
+//  C++ port of antlr4-c3 (TypeScript) by Mike Lischke
+//  Licensed under the MIT License.
+//
+
+#include "InputGenerator.hpp"
+
+#include <Token.h>
+#include <atn/ATN.h>
+#include <atn/ATNState.h>
+#include <atn/ATNStateType.h>
+#include <atn/PrecedencePredicateTransition.h>
+#include <atn/RuleStartState.h>
+#include <atn/RuleTransition.h>
+#include <atn/Transition.h>
+#include <atn/TransitionType.h>
+#include <misc/IntervalSet.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <random>
+#include <vector>
+
+namespace c3 {
+
+namespace {
+
+// How far to look ahead through epsilon transitions when checking decisions.
+constexpr size_t Lookahead = 8;
+
+constexpr size_t Unreachable = std::numeric_limits<size_t>::max();
+
+size_t saturatingAdd(size_t lhs, size_t rhs) {
+  return (lhs > Unreachable - rhs) ? Unreachable : lhs + rhs;
+}
+
+bool isTokenTransition(antlr4::atn::TransitionType type) {
+  switch (type) {
+    case antlr4::atn::TransitionType::ATOM:
+    case antlr4::atn::TransitionType::RANGE:
+    case antlr4::atn::TransitionType::SET:
+    case antlr4::atn::TransitionType::NOT_SET:
+    case antlr4::atn::TransitionType::WILDCARD:
+      return true;
+
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+InputGenerator::InputGenerator(const antlr4::atn::ATN& atn)
+    : atn(&atn), coverage(atn.ruleToStartState.size(), 0) {
+  computeMinCosts();
+}
+
+std::vector<size_t> InputGenerator::generate(GeneratorOptions const& options) {
+  random.seed(options.seed);
+
+  std::vector<size_t> result;
+  std::vector<Frame> frames;
+
+  antlr4::atn::ATNState* state = atn->ruleToStartState[options.startRule];
+  int precedence = 0;
+  ++coverage[options.startRule];
+
+  // Number of transitions taken since the last token was produced. Random
+  // walks through nullable loops could otherwise go on for a long time.
+  size_t idleSteps = 0;
+
+  while (true) {
+    if (state->getStateType() == antlr4::atn::ATNStateType::RULE_STOP) {
+      if (frames.empty()) {
+        break;
+      }
+
+      state = frames.back().followState;
+      precedence = frames.back().precedence;
+      frames.pop_back();
+      continue;
+    }
+
+    const bool shortest = result.size() >= options.maxLength ||
+                          frames.size() >= options.maxRecursionDepth ||
+                          idleSteps > atn->states.size();
+    const antlr4::atn::Transition* transition =
+        chooseTransition(state, precedence, shortest, options.coverageBias);
+    if (transition == nullptr) {
+      // Dead end. Cannot happen for ATNs generated from a valid grammar.
+      break;
+    }
+
+    if (transition->getTransitionType() == antlr4::atn::TransitionType::RULE) {
+      const auto* ruleTransition = dynamic_cast<const antlr4::atn::RuleTransition*>(transition);
+      frames.push_back({.followState = ruleTransition->followState, .precedence = precedence});
+      precedence = ruleTransition->precedence;
+      ++coverage[ruleTransition->target->ruleIndex];
+      ++idleSteps;
+    } else if (isTokenTransition(transition->getTransitionType())) {
+      const size_t token = chooseToken(transition);
+      if (token == antlr4::Token::EOF) {
+        break;
+      }
+
+      result.push_back(token);
+      idleSteps = 0;
+    } else {
+      ++idleSteps;
+    }
+
+    state = transition->target;
+  }
+
+  return result;
+}
+
+const std::vector<size_t>& InputGenerator::ruleCoverage() const {
+  return coverage;
+}
+
+/**
+ * Determines for each ATN state the shortest way to the end of its rule, by
+ * relaxing the transition costs until nothing changes anymore.
+ */
+void InputGenerator::computeMinCosts() {
+  minCost.assign(atn->states.size(), {Unreachable, Unreachable});
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+
+    for (const antlr4::atn::ATNState* state : atn->states) {
+      if (state == nullptr) {
+        continue;
+      }
+
+      Cost best = minCost[state->stateNumber];
+      if (state->getStateType() == antlr4::atn::ATNStateType::RULE_STOP) {
+        best = {0, 0};
+      } else {
+        for (const antlr4::atn::ConstTransitionPtr& transition : state->transitions) {
+          best = std::min(best, transitionCost(transition.get()));
+        }
+      }
+
+      if (best < minCost[state->stateNumber]) {
+        minCost[state->stateNumber] = best;
+        changed = true;
+      }
+    }
+  }
+}
+
+/**
+ * @param transition The transition to take.
+ * @returns The cost of the shortest way to the end of the current rule when
+ * taking the given transition.
+ */
+InputGenerator::Cost InputGenerator::transitionCost(const antlr4::atn::Transition* transition
+) const {
+  const Cost& target = minCost[transition->target->stateNumber];
+
+  if (transition->getTransitionType() == antlr4::atn::TransitionType::RULE) {
+    const auto* ruleTransition = dynamic_cast<const antlr4::atn::RuleTransition*>(transition);
+    const Cost& follow = minCost[ruleTransition->followState->stateNumber];
+    return {
+        saturatingAdd(target.first, follow.first),
+        saturatingAdd(saturatingAdd(target.second, follow.second), 1),
+    };
+  }
+
+  const size_t tokens = isTokenTransition(transition->getTransitionType()) ? 1 : 0;
+  return {saturatingAdd(target.first, tokens), saturatingAdd(target.second, 1)};
+}
+
+/**
+ * Checks if the given transition can be taken with the given precedence and
+ * does not lead into a dead end of failing precedence predicates.
+ *
+ * @param transition The transition to check.
+ * @param precedence The precedence of the current rule invocation.
+ * @returns true if the transition can be taken.
+ */
+bool InputGenerator::isAllowed(const antlr4::atn::Transition* transition, int precedence) const {
+  if (transitionCost(transition).first == Unreachable) {
+    return false;
+  }
+
+  switch (transition->getTransitionType()) {
+    case antlr4::atn::TransitionType::PRECEDENCE: {
+      const auto* predTransition =
+          dynamic_cast<const antlr4::atn::PrecedencePredicateTransition*>(transition);
+      return predTransition->getPrecedence() >= precedence &&
+             canProceed(transition->target, precedence, Lookahead);
+    }
+
+    case antlr4::atn::TransitionType::RULE:
+      return true;
+
+    default:
+      return isTokenTransition(transition->getTransitionType()) ||
+             canProceed(transition->target, precedence, Lookahead);
+  }
+}
+
+/**
+ * Looks ahead through epsilon transitions to see if any way from the given
+ * state is not blocked by precedence predicates.
+ *
+ * @param state The state to start from.
+ * @param precedence The precedence of the current rule invocation.
+ * @param lookahead The number of epsilon transitions to look through.
+ * @returns true if the walk can continue from the state.
+ */
+bool InputGenerator::canProceed(  // NOLINT: recursion
+    const antlr4::atn::ATNState* state,
+    int precedence,
+    size_t lookahead
+) const {
+  if (lookahead == 0 || state->getStateType() == antlr4::atn::ATNStateType::RULE_STOP) {
+    return true;
+  }
+
+  return std::ranges::any_of(state->transitions, [&](const auto& transition) {
+    switch (transition->getTransitionType()) {
+      case antlr4::atn::TransitionType::PRECEDENCE: {
+        const auto* predTransition =
+            dynamic_cast<const antlr4::atn::PrecedencePredicateTransition*>(transition.get());
+        return predTransition->getPrecedence() >= precedence &&
+               canProceed(transition->target, precedence, lookahead - 1);
+      }
+
+      case antlr4::atn::TransitionType::EPSILON:
+      case antlr4::atn::TransitionType::ACTION:
+      case antlr4::atn::TransitionType::PREDICATE:
+        return canProceed(transition->target, precedence, lookahead - 1);
+
+      default:
+        return true;
+    }
+  });
+}
+
+/**
+ * Follows a chain of single epsilon transitions to find the rule which taking
+ * the given transition enters, if any.
+ *
+ * @param transition The transition to start from.
+ * @returns The index of the entered rule.
+ */
+std::optional<size_t> InputGenerator::enteredRule(const antlr4::atn::Transition* transition
+) const {
+  for (size_t step = 0; step < Lookahead; ++step) {
+    if (transition->getTransitionType() == antlr4::atn::TransitionType::RULE) {
+      return transition->target->ruleIndex;
+    }
+
+    if (!transition->isEpsilon() || transition->target->transitions.size() != 1) {
+      break;
+    }
+
+    transition = transition->target->transitions[0].get();
+  }
+
+  return std::nullopt;
+}
+
+/**
+ * Picks the next transition to take from the given state.
+ *
+ * @param state The current state.
+ * @param precedence The precedence of the current rule invocation.
+ * @param shortest If true, take the shortest way to the end of the rule.
+ * @param coverageBias The probability to prefer the least invoked rule.
+ * @returns The transition to take or nullptr if there is none.
+ */
+const antlr4::atn::Transition* InputGenerator::chooseTransition(
+    const antlr4::atn::ATNState* state, int precedence, bool shortest, double coverageBias
+) {
+  std::vector<const antlr4::atn::Transition*> allowed;
+  for (const antlr4::atn::ConstTransitionPtr& transition : state->transitions) {
+    if (isAllowed(transition.get(), precedence)) {
+      allowed.push_back(transition.get());
+    }
+  }
+
+  if (allowed.empty()) {
+    return nullptr;
+  }
+
+  if (shortest) {
+    return *std::ranges::min_element(allowed, {}, [&](const antlr4::atn::Transition* transition) {
+      return transitionCost(transition);
+    });
+  }
+
+  if (allowed.size() > 1 && std::bernoulli_distribution(coverageBias)(random)) {
+    const antlr4::atn::Transition* leastCovered = nullptr;
+    size_t leastInvocations = Unreachable;
+    for (const antlr4::atn::Transition* transition : allowed) {
+      const std::optional<size_t> rule = enteredRule(transition);
+      if (rule.has_value() && coverage[*rule] < leastInvocations) {
+        leastInvocations = coverage[*rule];
+        leastCovered = transition;
+      }
+    }
+
+    if (leastCovered != nullptr) {
+      return leastCovered;
+    }
+  }
+
+  std::uniform_int_distribution<size_t> pick(0, allowed.size() - 1);
+  return allowed[pick(random)];
+}
+
+/**
+ * Picks one of the tokens matched by the given transition.
+ *
+ * @param transition A token consuming transition.
+ * @returns The token type.
+ */
+size_t InputGenerator::chooseToken(const antlr4::atn::Transition* transition) {
+  const auto allUserTokens = antlr4::misc::IntervalSet::of(
+      antlr4::Token::MIN_USER_TOKEN_TYPE, static_cast<ptrdiff_t>(atn->maxTokenType)
+  );
+
+  antlr4::misc::IntervalSet set;
+  switch (transition->getTransitionType()) {
+    case antlr4::atn::TransitionType::WILDCARD:
+      set = allUserTokens;
+      break;
+
+    case antlr4::atn::TransitionType::NOT_SET:
+      set = transition->label().complement(allUserTokens);
+      break;
+
+    default:
+      set = transition->label();
+  }
+
+  std::uniform_int_distribution<size_t> pick(0, set.size() - 1);
+  return static_cast<size_t>(set.get(static_cast<int>(pick(random))));
+}
+
+}  // namespace c3
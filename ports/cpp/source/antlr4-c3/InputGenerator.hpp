@@ -0,0 +1,122 @@
+//
+//  InputGenerator.hpp
+//
+//  C++ port of antlr4-c3 (TypeScript) by Mike Lischke
+//  Licensed under the MIT License.
+//
+
+#pragma once
+
+#include <atn/ATN.h>
+#include <atn/ATNState.h>
+#include <atn/Transition.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace c3 {
+
+/**
+ * Options for `InputGenerator::generate`.
+ */
+struct GeneratorOptions {
+  /** The rule to generate input for. */
+  size_t startRule = 0;
+
+  /**
+   * The number of tokens after which the generator only takes the shortest
+   * way to the end of the start rule. The result can therefore be somewhat
+   * longer than this value, but never by more than the open rules need to
+   * be completed.
+   */
+  size_t maxLength = 64;  // NOLINT: magic
+
+  /**
+   * The rule nesting depth from which on the generator only takes the
+   * shortest way out of the current rule.
+   */
+  size_t maxRecursionDepth = 32;  // NOLINT: magic
+
+  /**
+   * Probability (0..1) with which a decision that can enter different rules
+   * picks the rule with the fewest invocations so far, instead of a random
+   * alternative. Higher values spread inputs over more of the grammar.
+   */
+  double coverageBias = 0.5;  // NOLINT: magic
+
+  /**
+   * Seed for the random number generator. Equal seeds give equal inputs, as
+   * long as the rule coverage collected so far is equal, too.
+   */
+  uint64_t seed = 0;
+};
+
+/**
+ * Generates random, syntactically valid token type sequences by walking the
+ * parser ATN, with the same transition semantics as `CodeCompletionCore`:
+ * rule transitions carry their precedence, precedence predicates are checked
+ * against the current rule's precedence and semantic predicates are assumed
+ * to hold. The result can be fed directly to the token type overload of
+ * `CodeCompletionCore::collectCandidates`, e.g. to study how completion scales
+ * with input size and nesting depth.
+ */
+class InputGenerator {
+public:
+  explicit InputGenerator(const antlr4::atn::ATN& atn);
+
+  /**
+   * Generates one token type sequence. The end-of-file token is not part of
+   * the result.
+   *
+   * @param options Length, depth, coverage and seed settings.
+   * @returns The generated token types.
+   */
+  std::vector<size_t> generate(GeneratorOptions const& options);
+
+  /**
+   * @returns The number of invocations per rule index, summed over all inputs
+   * generated so far.
+   */
+  [[nodiscard]] const std::vector<size_t>& ruleCoverage() const;
+
+private:
+  /**
+   * The shortest way from a state to the end of its rule: the number of
+   * tokens, then the number of transitions taken. The second part makes
+   * every step on a shortest way strictly decrease the cost, which guarantees
+   * termination also through epsilon loops.
+   */
+  using Cost = std::pair<size_t, size_t>;
+
+  struct Frame {
+    antlr4::atn::ATNState* followState;
+    int precedence;
+  };
+
+  const antlr4::atn::ATN* atn;
+  std::vector<Cost> minCost;
+  std::vector<size_t> coverage;
+  std::mt19937_64 random;
+
+  void computeMinCosts();
+
+  Cost transitionCost(const antlr4::atn::Transition* transition) const;
+
+  bool isAllowed(const antlr4::atn::Transition* transition, int precedence) const;
+
+  bool canProceed(const antlr4::atn::ATNState* state, int precedence, size_t lookahead) const;
+
+  std::optional<size_t> enteredRule(const antlr4::atn::Transition* transition) const;
+
+  const antlr4::atn::Transition* chooseTransition(
+      const antlr4::atn::ATNState* state, int precedence, bool shortest, double coverageBias
+  );
+
+  size_t chooseToken(const antlr4::atn::Transition* transition);
+};
+
+}  // namespace c3
@@ -0,0 +1,118 @@
+//
+//  Metrics.cpp
+//
+//  C++ port of antlr4-c3 (TypeScript) by Mike Lischke
+//  Licensed under the MIT License.
+//
+
+#include "Metrics.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace c3 {
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Metrics recording must be lock-free");
+
+void Histogram::record(uint64_t value) {
+  const auto bucket = std::min<size_t>(std::bit_width(value), HistogramBuckets - 1);
+  buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  count.fetch_add(1, std::memory_order_relaxed);
+  sum.fetch_add(value, std::memory_order_relaxed);
+
+  uint64_t current = max.load(std::memory_order_relaxed);
+  while (current < value &&
+         !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+  }
+}
+
+HistogramSnapshot Histogram::snapshot() const {
+  HistogramSnapshot result;
+  for (size_t i = 0; i < HistogramBuckets; ++i) {
+    result.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+  }
+  result.count = count.load(std::memory_order_relaxed);
+  result.sum = sum.load(std::memory_order_relaxed);
+  result.max = max.load(std::memory_order_relaxed);
+  return result;
+}
+
+void GrammarMetrics::record(RequestMetrics const& request) {
+  const Statistics& statistics = request.statistics;
+
+  requests.fetch_add(1, std::memory_order_relaxed);
+  if (request.timedOut) {
+    timeouts.fetch_add(1, std::memory_order_relaxed);
+  }
+  if (request.cancelled) {
+    cancellations.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  statesProcessed.fetch_add(statistics.statesProcessed, std::memory_order_relaxed);
+  ruleInvocations.fetch_add(statistics.ruleInvocations, std::memory_order_relaxed);
+  shortcutHits.fetch_add(statistics.shortcutHits, std::memory_order_relaxed);
+  followSetsLookups.fetch_add(statistics.followSetsLookups, std::memory_order_relaxed);
+  followSetsComputed.fetch_add(statistics.followSetsComputed, std::memory_order_relaxed);
+
+  const auto microseconds =
+      std::chrono::duration_cast<std::chrono::microseconds>(request.latency).count();
+  latency.record(static_cast<uint64_t>(std::max<int64_t>(microseconds, 0)));
+  statesPerRequest.record(statistics.statesProcessed);
+}
+
+GrammarMetricsSnapshot GrammarMetrics::snapshot() const {
+  return {
+      .requests = requests.load(std::memory_order_relaxed),
+      .timeouts = timeouts.load(std::memory_order_relaxed),
+      .cancellations = cancellations.load(std::memory_order_relaxed),
+      .statesProcessed = statesProcessed.load(std::memory_order_relaxed),
+      .ruleInvocations = ruleInvocations.load(std::memory_order_relaxed),
+      .shortcutHits = shortcutHits.load(std::memory_order_relaxed),
+      .followSetsLookups = followSetsLookups.load(std::memory_order_relaxed),
+      .followSetsComputed = followSetsComputed.load(std::memory_order_relaxed),
+      .latency = latency.snapshot(),
+      .statesPerRequest = statesPerRequest.snapshot(),
+  };
+}
+
+MetricsRegistry& MetricsRegistry::instance() {
+  static MetricsRegistry registry;
+  return registry;
+}
+
+GrammarMetrics& MetricsRegistry::grammar(std::string const& grammarName) {
+  const std::scoped_lock lock(mutex);
+
+  std::unique_ptr<GrammarMetrics>& metrics = grammars[grammarName];
+  if (metrics == nullptr) {
+    metrics = std::make_unique<GrammarMetrics>();
+  }
+  return *metrics;
+}
+
+MetricsSnapshot MetricsRegistry::snapshot() const {
+  const std::scoped_lock lock(mutex);
+
+  MetricsSnapshot result;
+  for (const auto& [name, metrics] : grammars) {
+    result.grammars[name] = metrics->snapshot();
+  }
+  return result;
+}
+
+void MetricsRegistry::setEnabled(bool enabled) {
+  this->enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool MetricsRegistry::isEnabled() const {
+  return enabled.load(std::memory_order_relaxed);
+}
+
+}  // namespace c3
@@ -0,0 +1,156 @@
+//
+//  Metrics.hpp
+//
+//  C++ port of antlr4-c3 (TypeScript) by Mike Lischke
+//  Licensed under the MIT License.
+//
+
+#pragma once
+
+#include "CodeCompletionCore.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace c3 {
+
+/**
+ * Number of buckets of a metrics histogram. Bucket 0 counts zero values,
+ * bucket `i` counts values in [2^(i-1), 2^i), the last bucket everything
+ * above.
+ */
+constexpr size_t HistogramBuckets = 40;
+
+struct HistogramSnapshot {
+  std::array<uint64_t, HistogramBuckets> buckets = {};
+  uint64_t count = 0;
+  uint64_t sum = 0;
+  uint64_t max = 0;
+};
+
+/**
+ * Cumulative metrics of all completion requests for one grammar.
+ */
+struct GrammarMetricsSnapshot {
+  uint64_t requests = 0;
+  uint64_t timeouts = 0;
+  uint64_t cancellations = 0;
+
+  uint64_t statesProcessed = 0;
+  uint64_t ruleInvocations = 0;
+  uint64_t shortcutHits = 0;
+
+  /** Follow sets cache lookups and how many of them were misses. */
+  uint64_t followSetsLookups = 0;
+  uint64_t followSetsComputed = 0;
+
+  /** Request latency in microseconds. */
+  HistogramSnapshot latency;
+
+  /** ATN states processed per request. */
+  HistogramSnapshot statesPerRequest;
+};
+
+struct MetricsSnapshot {
+  /** Metrics per grammar, keyed by grammar file name. */
+  std::map<std::string, GrammarMetricsSnapshot> grammars;
+};
+
+/**
+ * A histogram which can be updated concurrently without locks.
+ */
+class Histogram {
+public:
+  void record(uint64_t value);
+
+  [[nodiscard]] HistogramSnapshot snapshot() const;
+
+private:
+  std::array<std::atomic<uint64_t>, HistogramBuckets> buckets = {};
+  std::atomic<uint64_t> count = 0;
+  std::atomic<uint64_t> sum = 0;
+  std::atomic<uint64_t> max = 0;
+};
+
+/**
+ * The outcome of a single completion request, as reported to the metrics.
+ */
+struct RequestMetrics {
+  std::chrono::nanoseconds latency;
+  Statistics statistics;
+  bool timedOut = false;
+  bool cancelled = false;
+};
+
+/**
+ * Cumulative metrics for one grammar. Recording only uses relaxed atomic
+ * updates, so any number of threads can record concurrently without
+ * contending on a lock.
+ */
+class GrammarMetrics {
+public:
+  void record(RequestMetrics const& request);
+
+  [[nodiscard]] GrammarMetricsSnapshot snapshot() const;
+
+private:
+  std::atomic<uint64_t> requests = 0;
+  std::atomic<uint64_t> timeouts = 0;
+  std::atomic<uint64_t> cancellations = 0;
+  std::atomic<uint64_t> statesProcessed = 0;
+  std::atomic<uint64_t> ruleInvocations = 0;
+  std::atomic<uint64_t> shortcutHits = 0;
+  std::atomic<uint64_t> followSetsLookups = 0;
+  std::atomic<uint64_t> followSetsComputed = 0;
+  Histogram latency;
+  Histogram statesPerRequest;
+};
+
+/**
+ * Process-wide registry of cumulative completion metrics, broken down per
+ * grammar. `CodeCompletionCore` records every `collectCandidates` call here.
+ * Only the registration of a grammar takes a lock, which happens once per
+ * `CodeCompletionCore` construction.
+ */
+class MetricsRegistry {
+public:
+  static MetricsRegistry& instance();
+
+  /**
+   * Returns the metrics for the given grammar, creating them if needed. The
+   * returned reference stays valid for the lifetime of the process.
+   *
+   * @param grammarName The grammar file name.
+   * @returns The metrics of the grammar.
+   */
+  GrammarMetrics& grammar(std::string const& grammarName);
+
+  /**
+   * @returns A copy of the current metrics of all grammars. Values recorded
+   * concurrently may or may not be included.
+   */
+  [[nodiscard]] MetricsSnapshot snapshot() const;
+
+  /**
+   * Enables or disables recording. Recording is enabled by default.
+   */
+  void setEnabled(bool enabled);
+
+  [[nodiscard]] bool isEnabled() const;
+
+private:
+  MetricsRegistry() = default;
+
+  mutable std::mutex mutex;
+  std::map<std::string, std::unique_ptr<GrammarMetrics>> grammars;
+  std::atomic<bool> enabled = true;
+};
+
+}  // namespace c3
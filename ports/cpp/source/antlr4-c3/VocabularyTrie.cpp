@@ -0,0 +1,138 @@
+//
+//  VocabularyTrie.cpp
+//
+//  C++ port of antlr4-c3 (TypeScript) by Mike Lischke
+//  Licensed under the MIT License.
+//
+
+#include "VocabularyTrie.hpp"
+
+#include <Token.h>
+#include <Vocabulary.h>
+
+#include <cctype>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace c3 {
+
+namespace {
+
+// Rough per-node bookkeeping costs of a tree map node: three pointers and the
+// color.
+constexpr size_t TreeNodeOverhead = 4 * sizeof(void*);
+
+char toLower(char character) {
+  return static_cast<char>(std::tolower(static_cast<unsigned char>(character)));
+}
+
+}  // namespace
+
+VocabularyTrie::VocabularyTrie(const antlr4::dfa::Vocabulary& vocabulary, size_t maxTokenType)
+    : nodes(1), names(maxTokenType + 1) {
+  for (size_t tokenType = antlr4::Token::MIN_USER_TOKEN_TYPE; tokenType <= maxTokenType;
+       ++tokenType) {
+    std::string name = vocabulary.getLiteralName(tokenType);
+    if (name.size() >= 2 && name.front() == '\'' && name.back() == '\'') {
+      name = name.substr(1, name.size() - 2);
+    } else {
+      name = vocabulary.getSymbolicName(tokenType);
+    }
+
+    for (char& character : name) {
+      character = toLower(character);
+    }
+
+    insert(name, tokenType);
+    names[tokenType] = std::move(name);
+  }
+}
+
+std::shared_ptr<const VocabularyTrie> VocabularyTrie::forVocabulary(
+    const antlr4::dfa::Vocabulary& vocabulary, size_t maxTokenType
+) {
+  static std::mutex mutex;
+  static std::map<const antlr4::dfa::Vocabulary*, std::weak_ptr<const VocabularyTrie>> tries;
+
+  const std::scoped_lock lock(mutex);
+
+  // Entries of freed tries must go, as the address of their vocabulary may be
+  // reused.
+  std::erase_if(tries, [](const auto& item) { return item.second.expired(); });
+
+  std::weak_ptr<const VocabularyTrie>& entry = tries[&vocabulary];
+  std::shared_ptr<const VocabularyTrie> trie = entry.lock();
+  if (trie == nullptr) {
+    trie = std::make_shared<const VocabularyTrie>(vocabulary, maxTokenType);
+    entry = trie;
+  }
+  return trie;
+}
+
+IndexSet VocabularyTrie::matching(std::string_view prefix) const {
+  size_t node = 0;
+  for (const char character : prefix) {
+    const auto iter = nodes[node].children.find(toLower(character));
+    if (iter == nodes[node].children.end()) {
+      return {};
+    }
+    node = iter->second;
+  }
+
+  IndexSet result;
+  std::vector<size_t> pending = {node};
+  while (!pending.empty()) {
+    const Node& current = nodes[pending.back()];
+    pending.pop_back();
+
+    for (const size_t tokenType : current.tokens) {
+      result.insert(tokenType);
+    }
+    for (const auto& [_, child] : current.children) {
+      pending.push_back(child);
+    }
+  }
+
+  return result;
+}
+
+const std::string& VocabularyTrie::name(size_t tokenType) const {
+  return names[tokenType];
+}
+
+size_t VocabularyTrie::bytes() const {
+  size_t result = nodes.capacity() * sizeof(Node) + names.capacity() * sizeof(std::string);
+  for (const Node& node : nodes) {
+    result += node.children.size() * (sizeof(std::pair<const char, size_t>) + TreeNodeOverhead);
+    result += node.tokens.capacity() * sizeof(size_t);
+  }
+  for (const std::string& name : names) {
+    result += name.capacity();
+  }
+  return result;
+}
+
+void VocabularyTrie::insert(std::string const& name, size_t tokenType) {
+  size_t node = 0;
+  for (const char character : name) {
+    const auto iter = nodes[node].children.find(character);
+    if (iter != nodes[node].children.end()) {
+      node = iter->second;
+      continue;
+    }
+
+    nodes.emplace_back();
+    nodes[node].children[character] = nodes.size() - 1;
+    node = nodes.size() - 1;
+  }
+
+  nodes[node].tokens.push_back(tokenType);
+}
+
+}  // namespace c3
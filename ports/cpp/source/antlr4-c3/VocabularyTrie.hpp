@@ -0,0 +1,74 @@
+//
+//  VocabularyTrie.hpp
+//
+//  C++ port of antlr4-c3 (TypeScript) by Mike Lischke
+//  Licensed under the MIT License.
+//
+
+#pragma once
+
+#include "IndexSet.hpp"
+
+#include <Vocabulary.h>
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace c3 {
+
+/**
+ * A case-insensitive prefix trie over the token names of a vocabulary. A
+ * token is named by its literal name without quotes (e.g. `SELECT` for
+ * `'SELECT'`) or, if it has none, by its symbolic name.
+ */
+class VocabularyTrie {
+public:
+  VocabularyTrie(const antlr4::dfa::Vocabulary& vocabulary, size_t maxTokenType);
+
+  /**
+   * Returns the trie of the given vocabulary, shared by everyone who holds
+   * it, building it if nobody does. The trie is freed with its last holder.
+   * Thread-safe.
+   *
+   * @param vocabulary The vocabulary.
+   * @param maxTokenType The largest token type of the vocabulary.
+   * @returns The shared trie.
+   */
+  static std::shared_ptr<const VocabularyTrie> forVocabulary(
+      const antlr4::dfa::Vocabulary& vocabulary, size_t maxTokenType
+  );
+
+  /**
+   * @param prefix The text to match, compared case-insensitively.
+   * @returns All token types whose name starts with the prefix.
+   */
+  [[nodiscard]] IndexSet matching(std::string_view prefix) const;
+
+  /**
+   * @param tokenType A token type.
+   * @returns The (lower case) name used for the token type.
+   */
+  [[nodiscard]] const std::string& name(size_t tokenType) const;
+
+  /**
+   * @returns The approximate number of bytes held by the trie.
+   */
+  [[nodiscard]] size_t bytes() const;
+
+private:
+  struct Node {
+    std::map<char, size_t> children;
+    std::vector<size_t> tokens;
+  };
+
+  std::vector<Node> nodes;
+  std::vector<std::string> names;
+
+  void insert(std::string const& name, size_t tokenType);
+};
+
+}  // namespace c3
@@ -4,9 +4,11 @@
 #include <gtest/gtest.h>
 
 #include <antlr4-c3/CodeCompletionCore.hpp>
+#include <antlr4-c3/GrammarModel.hpp>
 #include <filesystem>
 #include <fstream>
 #include <iterator>
+#include <memory>
 #include <string>
 #include <utility/AntlrPipeline.hpp>
 #include <utility/Collections.hpp>
@@ -476,4 +478,31 @@ TEST(CPP14Parser, RealCppFile) {  // NOLINT: complexity
   }
 }
 
+TEST(CPP14Parser, SplicedFollowSets) {
+  // The follow sets of rules which cannot invoke themselves are spliced into
+  // those of the rules invoking them. The grammar nests such rules deeply,
+  // next to large groups of mutually recursive rules, which are still walked.
+  AntlrPipeline<Cpp14Grammar> pipeline("");
+  const auto& atn = pipeline.parser.getATN();
+
+  auto spliced = std::make_shared<const GrammarModel>(pipeline.parser);
+  CodeCompletionCore(spliced, &pipeline.parser).buildFollowSets(1);
+
+  auto walked = std::make_shared<const GrammarModel>(pipeline.parser);
+  CodeCompletionCore completion(walked, &pipeline.parser);
+  completion.debugOptions.disableFollowSetsSplicing = true;
+  completion.buildFollowSets(1);
+
+  const auto any = [](const FollowSetsHolder& /*holder*/) { return true; };
+  for (const auto* start : atn.ruleToStartState) {
+    const auto actual = spliced->followSets().find(start->stateNumber, any);
+    const auto expected = walked->followSets().find(start->stateNumber, any);
+    ASSERT_NE(actual, nullptr);
+    ASSERT_NE(expected, nullptr);
+    EXPECT_EQ(actual->sets, expected->sets) << pipeline.parser.getRuleNames()[start->ruleIndex];
+    EXPECT_EQ(actual->combined, expected->combined);
+    EXPECT_EQ(actual->isExhaustive, expected->isExhaustive);
+  }
+}
+
 }  // namespace c3::test
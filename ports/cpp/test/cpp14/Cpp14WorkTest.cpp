@@ -0,0 +1,64 @@
+#include <CPP14Lexer.h>
+#include <CPP14Parser.h>
+#include <gtest/gtest.h>
+
+#include <utility/WorkCounters.hpp>
+
+namespace c3::test {
+
+namespace {
+
+struct Cpp14Grammar {
+  using Lexer = CPP14Lexer;
+  using Parser = CPP14Parser;
+};
+
+// Each case has its own limits, a quarter above its counts, so that a
+// regression by a small factor already fails. Update them together with
+// changes which are meant to alter the amount of work, from the counts a run
+// records as test properties.
+//
+// The MethodBody limits and the follow sets and allocation limits of
+// InputStart are estimates which have not been checked against a run yet.
+// Replace them with the recorded counts plus a quarter.
+
+// At the first token the start rule's follow sets are the candidates and the
+// walk returns before processing any state, so its state and rule counts
+// follow from the code path.
+constexpr WorkLimits InputStartLimits = {
+    .statesProcessed = 0,
+    .ruleInvocations = 1,
+    .followSetsStates = 60'000,
+    .allocations = 1'200,
+};
+
+constexpr WorkLimits MethodBodyLimits = {
+    .statesProcessed = 6'000,
+    .ruleInvocations = 1'500,
+    .followSetsStates = 120'000,
+    .allocations = 25'000,
+};
+
+const auto* const Source =
+    "class A {\n"
+    "public:\n"
+    "  void test() {\n"
+    "  }\n"
+    "};\n";
+
+const antlr4::ParserRuleContext* Parse(CPP14Parser& parser) {
+  parser.translationunit();
+  return nullptr;
+}
+
+}  // namespace
+
+TEST(CPP14WorkCounters, InputStart) {
+  ExpectWorkWithinLimits<Cpp14Grammar>({Source, 0, InputStartLimits}, Parse);
+}
+
+TEST(CPP14WorkCounters, MethodBody) {
+  ExpectWorkWithinLimits<Cpp14Grammar>({Source, 10, MethodBodyLimits}, Parse);  // NOLINT: magic
+}
+
+}  // namespace c3::test
@@ -0,0 +1,43 @@
+grammar Dialect;
+
+// Statements of two language dialects, told apart by semantic predicates.
+// The predicates are C++ code, so this grammar is only used by the C++ port.
+
+@parser::members {
+/** Enables the statements of the extended dialect. */
+bool extended = false;
+
+/** The number of times a dialect predicate was evaluated. */
+size_t evaluations = 0;
+
+bool isExtended() {
+  ++evaluations;
+  return extended;
+}
+}
+
+program: statement+;
+
+statement:
+    {isExtended()}? LOOP ID
+    | {!isExtended()}? GOTO ID
+    // Enters an expression after '+' with the lowest precedence, where the
+    // alternative below enters it with the precedence of '+'.
+    | ID PLUS expression COLON
+    | expression DOT
+;
+
+expression: expression STAR expression | expression PLUS expression | ID;
+
+// A jump target as the whole input. Its follow set continues up to EOF.
+label: ID COLON EOF;
+
+LOOP: 'loop';
+GOTO: 'goto';
+
+PLUS:  '+';
+STAR:  '*';
+COLON: ':';
+DOT:   '.';
+ID:    [a-zA-Z] [a-zA-Z0-9_]*;
+WS:    [ \n\r\t] -> skip;
@@ -0,0 +1,206 @@
+#include <DialectFollowSets.hpp>
+#include <DialectLexer.h>
+#include <DialectParser.h>
+#include <Token.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <antlr4-c3/Checkpoints.hpp>
+#include <antlr4-c3/CodeCompletionCore.hpp>
+#include <antlr4-c3/FollowSetsTables.hpp>
+#include <antlr4-c3/GrammarAnalysis.hpp>
+#include <antlr4-c3/GrammarModel.hpp>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <utility/AntlrPipeline.hpp>
+#include <utility/Collections.hpp>
+#include <utility/Testing.hpp>
+#include <vector>
+
+namespace c3::test {
+
+struct DialectGrammar {
+  using Lexer = DialectLexer;
+  using Parser = DialectParser;
+};
+
+TEST(DialectParser, PredicateCacheVariants) {
+  AntlrPipeline<DialectGrammar> pipeline("goto a");
+  pipeline.tokens.fill();
+
+  auto model = std::make_shared<const c3::GrammarModel>(pipeline.parser);
+  c3::CodeCompletionCore completion(model, &pipeline.parser);
+
+  auto candidates = completion.collectCandidates(0);
+  EXPECT_THAT(Keys(candidates.tokens), UnorderedElementsAre(DialectLexer::GOTO, DialectLexer::ID));
+  const std::size_t variants = model->followSets().size();
+  EXPECT_EQ(completion.statistics().followSetsComputed, variants);
+
+  // The cached follow sets were determined with other outcomes, so new
+  // variants are added next to them.
+  pipeline.parser.extended = true;
+  candidates = completion.collectCandidates(0);
+  EXPECT_THAT(Keys(candidates.tokens), UnorderedElementsAre(DialectLexer::LOOP, DialectLexer::ID));
+  EXPECT_EQ(completion.statistics().followSetsComputed, variants);
+  EXPECT_EQ(model->followSets().size(), 2 * variants);
+
+  // Both variants are reused once their outcomes match again.
+  pipeline.parser.extended = false;
+  candidates = completion.collectCandidates(0);
+  EXPECT_THAT(Keys(candidates.tokens), UnorderedElementsAre(DialectLexer::GOTO, DialectLexer::ID));
+  EXPECT_EQ(completion.statistics().followSetsComputed, 0);
+
+  pipeline.parser.extended = true;
+  candidates = completion.collectCandidates(0);
+  EXPECT_THAT(Keys(candidates.tokens), UnorderedElementsAre(DialectLexer::LOOP, DialectLexer::ID));
+  EXPECT_EQ(completion.statistics().followSetsComputed, 0);
+  EXPECT_EQ(model->followSets().size(), 2 * variants);
+}
+
+TEST(DialectParser, PredicateEvaluations) {
+  // The 'goto' predicate is reached for each of the three statements.
+  AntlrPipeline<DialectGrammar> pipeline("goto a goto b goto c");
+  pipeline.tokens.fill();
+
+  c3::CodeCompletionCore completion(&pipeline.parser);
+  for (std::size_t run = 0; run < 2; ++run) {
+    pipeline.parser.evaluations = 0;
+    const auto candidates = completion.collectCandidates(6);  // NOLINT: magic
+    EXPECT_THAT(
+        Keys(candidates.tokens), UnorderedElementsAre(DialectLexer::GOTO, DialectLexer::ID)
+    );
+
+    // Each predicate is evaluated once per call, and only those evaluations
+    // are counted.
+    EXPECT_EQ(pipeline.parser.evaluations, 2);
+    EXPECT_EQ(completion.statistics().predicateEvaluations, pipeline.parser.evaluations);
+  }
+}
+
+TEST(DialectParser, PredicateEvaluatorHook) {
+  AntlrPipeline<DialectGrammar> pipeline("loop a");
+  pipeline.tokens.fill();
+
+  bool loop = false;
+  bool jump = false;
+  std::size_t calls = 0;
+
+  c3::CodeCompletionCore completion(&pipeline.parser);
+  completion.predicateEvaluator = [&](std::span<const c3::PredicateKey> predicates) {
+    ++calls;
+    EXPECT_THAT(
+        predicates,
+        ElementsAre(
+            c3::PredicateKey{.ruleIndex = DialectParser::RuleStatement, .predIndex = 0},
+            c3::PredicateKey{.ruleIndex = DialectParser::RuleStatement, .predIndex = 1}
+        )
+    );
+    return std::vector<bool>{loop, jump};
+  };
+
+  // The hook decides, whatever the parser's dialect is.
+  pipeline.parser.evaluations = 0;
+  loop = true;
+  jump = true;
+  auto candidates = completion.collectCandidates(0);
+  EXPECT_THAT(
+      Keys(candidates.tokens),
+      UnorderedElementsAre(DialectLexer::LOOP, DialectLexer::GOTO, DialectLexer::ID)
+  );
+
+  // The walk follows only the alternatives the hook enables.
+  jump = false;
+  candidates = completion.collectCandidates(2);
+  EXPECT_THAT(Keys(candidates.tokens), UnorderedElementsAre(DialectLexer::LOOP, DialectLexer::ID));
+
+  loop = false;
+  candidates = completion.collectCandidates(2);
+  EXPECT_THAT(Keys(candidates.tokens), ElementsAre());
+
+  EXPECT_EQ(calls, 3);
+  EXPECT_EQ(pipeline.parser.evaluations, 0);
+  EXPECT_EQ(completion.statistics().predicateEvaluations, 0);
+}
+
+TEST(DialectParser, PrecedenceMemo) {
+  // 'b' starts the right operand of the first '+' in "a + b + c .", which
+  // cannot extend over the second '+', and an expression with the lowest
+  // precedence in "a + b + c :". The operand is walked first, so the second
+  // walk must not take its end positions from the memo.
+  AntlrPipeline<DialectGrammar> pipeline("a + b + c");
+  pipeline.tokens.fill();
+
+  c3::CodeCompletionCore completion(&pipeline.parser);
+  for (const auto order : {c3::ExplorationOrder::DepthFirst, c3::ExplorationOrder::BestFirst}) {
+    const auto candidates = completion.collectCandidates(5, {.order = order});  // NOLINT: magic
+    EXPECT_THAT(
+        Keys(candidates.tokens),
+        UnorderedElementsAre(
+            DialectLexer::PLUS, DialectLexer::STAR, DialectLexer::COLON, DialectLexer::DOT
+        )
+    );
+  }
+}
+
+TEST(DialectParser, CheckpointsWithOtherPredicates) {
+  // 'goto' statements only exist in the base dialect, so the extended one
+  // rejects the input right at its start.
+  AntlrPipeline<DialectGrammar> pipeline("goto a goto b goto c");
+  pipeline.tokens.fill();
+
+  c3::CheckpointOptions options;
+  options.interval = 2;  // NOLINT: magic
+  c3::Checkpoints checkpoints(options);
+
+  c3::CodeCompletionCore walked(&pipeline.parser);
+  c3::CodeCompletionCore completion(&pipeline.parser);
+  for (const bool extended : {false, true, false}) {
+    pipeline.parser.extended = extended;
+    const auto expected = walked.collectCandidates(10);  // NOLINT: magic
+    if (extended) {
+      EXPECT_THAT(Keys(expected.tokens), ElementsAre());
+    } else {
+      EXPECT_THAT(Keys(expected.tokens), ElementsAre(DialectLexer::ID));
+    }
+
+    // Checkpoints recorded in the other dialect are not resumed.
+    const auto actual = completion.collectCandidates(10, {.checkpoints = &checkpoints});
+    EXPECT_EQ(actual, expected);
+    EXPECT_GT(checkpoints.size(), 0);
+  }
+}
+
+TEST(DialectParser, GeneratedFollowSets) {
+  AntlrPipeline<DialectGrammar> pipeline("goto a goto b");
+  pipeline.tokens.fill();
+  const auto& atn = pipeline.parser.getATN();
+
+  auto lazy = std::make_shared<const c3::GrammarModel>(pipeline.parser);
+  c3::CodeCompletionCore lazyCompletion(lazy, &pipeline.parser);
+
+  auto model = std::make_shared<const c3::GrammarModel>(pipeline.parser);
+  c3::CodeCompletionCore completion(model, &pipeline.parser);
+  EXPECT_TRUE(completion.loadFollowSets(c3::tables::DialectFollowSets));
+  EXPECT_EQ(model->followSets().size(), atn.ruleToStartState.size());
+
+  // The tokens following the 'label' identifier end with EOF, which the
+  // tables store as the largest std::size_t.
+  const auto any = [](const c3::FollowSetsHolder& /*holder*/) { return true; };
+  const auto label = model->followSets().find(
+      atn.ruleToStartState[DialectParser::RuleLabel]->stateNumber, any
+  );
+  ASSERT_NE(label, nullptr);
+  ASSERT_EQ(label->sets.size(), 1);
+  EXPECT_THAT(
+      label->sets[0].following,
+      ElementsAre(DialectLexer::COLON, static_cast<std::size_t>(antlr4::Token::EOF))
+  );
+
+  for (std::size_t k = 0; k <= 4; ++k) {  // NOLINT: magic
+    EXPECT_EQ(completion.collectCandidates(k), lazyCompletion.collectCandidates(k));
+    EXPECT_EQ(completion.statistics().followSetsComputed, 0);
+  }
+}
+
+}  // namespace c3::test
@@ -1,14 +1,42 @@
+#include <CommonToken.h>
+#include <CommonTokenStream.h>
+#include <ExprFollowSets.hpp>
 #include <ExprLexer.h>
 #include <ExprParser.h>
+#include <ListTokenSource.h>
+#include <Token.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <antlr4-c3/BatchCompletion.hpp>
+#include <antlr4-c3/Checkpoints.hpp>
 #include <antlr4-c3/CodeCompletionCore.hpp>
+#include <antlr4-c3/FollowSetsTables.hpp>
+#include <antlr4-c3/GrammarAnalysis.hpp>
+#include <antlr4-c3/GrammarCompletionCore.hpp>
+#include <antlr4-c3/GrammarModel.hpp>
+#include <antlr4-c3/GrammarRegistry.hpp>
+#include <antlr4-c3/IndexSet.hpp>
+#include <antlr4-c3/InputGenerator.hpp>
+#include <antlr4-c3/Metrics.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
 #include <thread>
 #include <utility/AntlrPipeline.hpp>
 #include <utility/Collections.hpp>
 #include <utility/Testing.hpp>
 
+template <>
+struct c3::GrammarTraits<ExprParser> {
+  static constexpr std::size_t TokenCount = ExprParser::WS + 1;
+  static constexpr std::size_t RuleCount = ExprParser::RuleIdentifier + 1;
+};
+
 namespace c3::test {
 
 struct ExprGrammar {
@@ -16,6 +44,24 @@ struct ExprGrammar {
   using Parser = ExprParser;
 };
 
+std::size_t CountParseErrors(const std::vector<std::size_t>& tokenTypes) {
+  std::vector<std::unique_ptr<antlr4::Token>> list;
+  for (const std::size_t type : tokenTypes) {
+    list.push_back(std::make_unique<antlr4::CommonToken>(type, ""));
+  }
+
+  antlr4::ListTokenSource source(std::move(list));
+  antlr4::CommonTokenStream stream(&source);
+  ExprParser parser(&stream);
+  CountingErrorListener listener;
+  parser.removeErrorListeners();
+  parser.addErrorListener(&listener);
+  parser.expression();
+
+  // Trailing tokens which the rule did not consume count as an error, too.
+  return listener.GetErrorCount() + (stream.LA(1) == antlr4::Token::EOF ? 0 : 1);
+}
+
 TEST(SimpleExpressionParser, MostSimpleSetup) {
   AntlrPipeline<ExprGrammar> pipeline("var c = a + b()");
   pipeline.parser.expression();
@@ -210,6 +256,156 @@ TEST(SimpleExpressionParser, CandidateRulesWithDifferentStartTokens) {
   }
 }
 
+TEST(SimpleExpressionParser, AllRulePaths) {
+  AntlrPipeline<ExprGrammar> pipeline("var c = a + b");
+  pipeline.tokens.fill();
+
+  c3::CodeCompletionCore completion(&pipeline.parser);
+  completion.preferredRules = {
+      ExprParser::RuleSimpleExpression,
+      ExprParser::RuleVariableRef,
+  };
+
+  for (const bool topDown : {false, true}) {
+    completion.translateRulesTopDown = topDown;
+
+    const auto plain = completion.collectCandidates(10);  // NOLINT: magic
+    EXPECT_TRUE(plain.ruleOccurrences.empty());
+
+    const auto all = completion.collectCandidates(10, {.collectRulePaths = true});  // NOLINT
+    EXPECT_EQ(all.rules, plain.rules);
+    EXPECT_EQ(Keys(all.ruleOccurrences), Keys(all.rules));
+
+    for (const auto& [rule, candidate] : all.rules) {
+      const auto& occurrences = all.ruleOccurrences.at(rule);
+
+      // The single entry in rules is one of the occurrences.
+      EXPECT_TRUE(std::ranges::any_of(occurrences, [&](const auto& occurrence) {
+        return occurrence.startTokenIndex == candidate.startTokenIndex &&
+               std::ranges::equal(all.path(occurrence), candidate.ruleList);
+      }));
+
+      // No occurrence is listed twice.
+      for (std::size_t i = 0; i < occurrences.size(); ++i) {
+        for (std::size_t j = i + 1; j < occurrences.size(); ++j) {
+          EXPECT_FALSE(
+              occurrences[i].startTokenIndex == occurrences[j].startTokenIndex &&
+              std::ranges::equal(all.path(occurrences[i]), all.path(occurrences[j]))
+          );
+        }
+      }
+    }
+  }
+}
+
+TEST(SimpleExpressionParser, RulePathsOfOneRule) {
+  AntlrPipeline<ExprGrammar> pipeline("var c = a + b");
+  pipeline.tokens.fill();
+
+  c3::CodeCompletionCore completion(&pipeline.parser);
+  completion.preferredRules = {ExprParser::RuleIdentifier};
+
+  // The identifier at 'a' is that of a variable or of a function reference.
+  const auto candidates = completion.collectCandidates(6, {.collectRulePaths = true});  // NOLINT
+  ASSERT_TRUE(candidates.ruleOccurrences.contains(ExprParser::RuleIdentifier));
+
+  std::vector<std::vector<std::size_t>> paths;
+  for (const auto& occurrence : candidates.ruleOccurrences.at(ExprParser::RuleIdentifier)) {
+    EXPECT_EQ(occurrence.startTokenIndex, 6);
+    const auto path = candidates.path(occurrence);
+    paths.emplace_back(path.begin(), path.end());
+  }
+  EXPECT_THAT(
+      paths,
+      UnorderedElementsAre(
+          ElementsAre(
+              ExprParser::RuleExpression,
+              ExprParser::RuleAssignment,
+              ExprParser::RuleSimpleExpression,
+              ExprParser::RuleVariableRef
+          ),
+          ElementsAre(
+              ExprParser::RuleExpression,
+              ExprParser::RuleAssignment,
+              ExprParser::RuleSimpleExpression,
+              ExprParser::RuleFunctionRef
+          )
+      )
+  );
+
+  const auto& ruleList = candidates.rules.at(ExprParser::RuleIdentifier).ruleList;
+  EXPECT_NE(std::ranges::find(paths, ruleList), paths.end());
+}
+
+TEST(SimpleExpressionParser, IndexSetFromRange) {
+  const std::vector<std::size_t> rules = {
+      ExprParser::RuleVariableRef,
+      ExprParser::RuleFunctionRef,
+      ExprParser::RuleVariableRef,
+  };
+  c3::IndexSet set(rules);
+
+  EXPECT_EQ(set.size(), 2);
+  EXPECT_TRUE(set.contains(ExprParser::RuleFunctionRef));
+  EXPECT_FALSE(set.contains(ExprParser::RuleIdentifier));
+  EXPECT_FALSE(set.contains(static_cast<std::size_t>(antlr4::Token::EOF)));
+  EXPECT_THAT(set, ElementsAre(ExprParser::RuleVariableRef, ExprParser::RuleFunctionRef));
+
+  set.erase(ExprParser::RuleVariableRef);
+  EXPECT_EQ(set, c3::IndexSet({ExprParser::RuleFunctionRef}));
+}
+
+TEST(SimpleExpressionParser, IndexSetWithEOF) {
+  const auto eof = static_cast<std::size_t>(antlr4::Token::EOF);
+
+  c3::IndexSet set = {eof, ExprLexer::ID};
+  EXPECT_EQ(set.size(), 2);
+  EXPECT_TRUE(set.contains(eof));
+  EXPECT_THAT(set, ElementsAre(ExprLexer::ID, eof));
+  EXPECT_EQ(set, c3::IndexSet(std::vector<std::size_t>{ExprLexer::ID, eof, ExprLexer::ID}));
+  EXPECT_LT(set.bytes(), 64);  // NOLINT: magic
+
+  EXPECT_EQ(set.find(eof), std::next(set.begin()));
+  EXPECT_EQ(set.count(eof), 1);
+  EXPECT_FALSE(set.emplace(eof).second);
+  EXPECT_EQ(*set.insert(ExprLexer::VAR).first, ExprLexer::VAR);
+  EXPECT_EQ(set.erase(ExprLexer::VAR), 1);
+
+  EXPECT_EQ(set.erase(eof), 1);
+  EXPECT_EQ(set.find(eof), set.end());
+  EXPECT_EQ(set.count(eof), 0);
+  EXPECT_FALSE(set.contains(eof));
+  EXPECT_EQ(set.size(), 1);
+  EXPECT_EQ(set, c3::IndexSet({ExprLexer::ID}));
+
+  AntlrPipeline<ExprGrammar> pipeline("var c = a + b");
+  pipeline.tokens.fill();
+
+  c3::CodeCompletionCore completion(&pipeline.parser);
+  completion.ignoredTokens = {eof, ExprLexer::ID};
+  const auto candidates = completion.collectCandidates(0);
+  EXPECT_THAT(Keys(candidates.tokens), UnorderedElementsAre(ExprLexer::VAR, ExprLexer::LET));
+}
+
+TEST(SimpleExpressionParser, TypedPrefix) {
+  AntlrPipeline<ExprGrammar> pipeline("var c = a + b");
+  pipeline.tokens.fill();
+
+  c3::CodeCompletionCore completion(&pipeline.parser);
+
+  EXPECT_THAT(
+      Keys(completion.collectCandidates(0, {.prefix = "v"}).tokens), ElementsAre(ExprLexer::VAR)
+  );
+  EXPECT_THAT(
+      Keys(completion.collectCandidates(0, {.prefix = "LE"}).tokens), ElementsAre(ExprLexer::LET)
+  );
+  EXPECT_TRUE(completion.collectCandidates(0, {.prefix = "vax"}).tokens.empty());
+
+  // Following tokens are not filtered.
+  auto candidates = completion.collectCandidates(0, {.prefix = "Var"});
+  EXPECT_THAT(candidates.tokens[ExprLexer::VAR], ElementsAre(ExprLexer::ID, ExprLexer::EQUAL));
+}
+
 TEST(SimpleExpressionParser, OutOfBoundsCaret) {
   AntlrPipeline<ExprGrammar> pipeline("var c = a + b");
   pipeline.tokens.fill();
@@ -223,6 +419,508 @@ TEST(SimpleExpressionParser, OutOfBoundsCaret) {
   ASSERT_EQ(last, completion.collectCandidates(128));
 }
 
+TEST(SimpleExpressionParser, MemoryAccounting) {
+  AntlrPipeline<ExprGrammar> pipeline("var c = a + b");
+  pipeline.tokens.fill();
+
+  // The follow sets cache belongs to the model, so use fresh models for
+  // stable numbers.
+  auto model = std::make_shared<const c3::GrammarModel>(pipeline.parser);
+  c3::CodeCompletionCore completion(model, &pipeline.parser);
+  EXPECT_EQ(completion.memoryUsage().followSetsEntries, 0);
+
+  const auto expected = completion.collectCandidates(6);  // NOLINT: magic
+
+  auto usage = completion.memoryUsage();
+  EXPECT_GT(usage.followSetsEntries, 1);
+  EXPECT_GT(usage.followSetsBytes, 0);
+  EXPECT_GT(usage.memoBytes, 0);
+  EXPECT_EQ(usage.followSetsEvictions, 0);
+
+  // The limit belongs to the model, as all its requests share the cache.
+  c3::CompletionOptions options;
+  options.followSetsCacheLimit = 1;
+  auto boundedModel = std::make_shared<const c3::GrammarModel>(pipeline.parser, options);
+  c3::CodeCompletionCore bounded(boundedModel, &pipeline.parser);
+
+  // Eviction must never change the result.
+  EXPECT_EQ(bounded.collectCandidates(6), expected);  // NOLINT: magic
+
+  usage = bounded.memoryUsage();
+  EXPECT_EQ(usage.followSetsEntries, 1);
+  EXPECT_GT(usage.followSetsEvictions, 0);
+
+  // Other models of the grammar keep their follow sets.
+  EXPECT_GT(completion.memoryUsage().followSetsEntries, 1);
+}
+
+TEST(SimpleExpressionParser, TokenTypeInput) {
+  AntlrPipeline<ExprGrammar> pipeline("var c = a + b");
+  pipeline.tokens.fill();
+
+  c3::CodeCompletionCore completion(&pipeline.parser);
+
+  // The same input as the token stream up to the caret on 'b'.
+  const std::vector<std::size_t> tokenTypes = {
+      ExprLexer::VAR,
+      ExprLexer::ID,
+      ExprLexer::EQUAL,
+      ExprLexer::ID,
+      ExprLexer::PLUS,
+  };
+  const auto expected = completion.collectCandidates(10);  // NOLINT: magic
+  EXPECT_EQ(completion.collectCandidates(tokenTypes).tokens, expected.tokens);
+}
+
+TEST(SimpleExpressionParser, WithoutParser) {
+  AntlrPipeline<ExprGrammar> pipeline("var c = a + b");
+  pipeline.tokens.fill();
+
+  c3::CodeCompletionCore withParser(&pipeline.parser);
+  const auto expected = withParser.collectCandidates(10);  // NOLINT: magic
+
+  // The grammar data of generated parsers is static, so it outlives the parser.
+  c3::CodeCompletionCore completion(
+      pipeline.parser.getATN(), pipeline.parser.getVocabulary(), pipeline.parser.getRuleNames()
+  );
+  EXPECT_EQ(completion.collectCandidates(pipeline.tokens, 10), expected);  // NOLINT: magic
+  EXPECT_THROW(completion.collectCandidates(10), std::logic_error);  // NOLINT: magic
+  EXPECT_THROW(completion.isViablePrefix(10), std::logic_error);     // NOLINT: magic
+
+  const std::vector<std::size_t> tokenTypes = {
+      ExprLexer::VAR,
+      ExprLexer::ID,
+      ExprLexer::EQUAL,
+      ExprLexer::ID,
+      ExprLexer::PLUS,
+  };
+  EXPECT_EQ(completion.collectCandidates(tokenTypes).tokens, expected.tokens);
+}
+
+TEST(SimpleExpressionParser, GeneratedInput) {
+  AntlrPipeline<ExprGrammar> pipeline("");
+  c3::CodeCompletionCore completion(&pipeline.parser);
+  c3::InputGenerator generator(pipeline.parser.getATN());
+
+  for (std::uint64_t seed = 0; seed < 32; ++seed) {  // NOLINT: magic
+    const auto input = generator.generate({
+        .maxLength = 16,
+        .maxRecursionDepth = 8,
+        .coverageBias = 1.0,
+        .seed = seed,
+    });
+
+    EXPECT_FALSE(input.empty());
+    EXPECT_EQ(CountParseErrors(input), 0);
+
+    // Every expression can be continued, at least by an operator.
+    EXPECT_FALSE(completion.collectCandidates(input).tokens.empty());
+  }
+
+  for (const std::size_t invocations : generator.ruleCoverage()) {
+    EXPECT_GT(invocations, 0);
+  }
+}
+
+TEST(SimpleExpressionParser, GeneratedShortestInput) {
+  AntlrPipeline<ExprGrammar> pipeline("");
+  c3::InputGenerator generator(pipeline.parser.getATN());
+
+  // Without any length budget only the shortest expression is left.
+  EXPECT_THAT(generator.generate({.maxLength = 0}), ElementsAre(ExprLexer::ID));
+}
+
+TEST(SimpleExpressionParser, GeneratorIsDeterministic) {
+  AntlrPipeline<ExprGrammar> pipeline("");
+  c3::InputGenerator first(pipeline.parser.getATN());
+  c3::InputGenerator second(pipeline.parser.getATN());
+
+  for (std::uint64_t seed = 0; seed < 8; ++seed) {  // NOLINT: magic
+    EXPECT_EQ(first.generate({.seed = seed}), second.generate({.seed = seed}));
+  }
+}
+
+TEST(SimpleExpressionParser, BestFirstOrder) {
+  AntlrPipeline<ExprGrammar> pipeline("var c = a + b");
+  pipeline.tokens.fill();
+
+  c3::CodeCompletionCore completion(&pipeline.parser);
+
+  // Without limits the exploration order does not change the candidates.
+  for (std::size_t caret = 0; caret < 8; ++caret) {  // NOLINT: magic
+    const auto depthFirst = completion.collectCandidates(caret);
+    const auto bestFirst =
+        completion.collectCandidates(caret, {.order = c3::ExplorationOrder::BestFirst});
+    EXPECT_EQ(Keys(bestFirst.tokens), Keys(depthFirst.tokens));
+    EXPECT_EQ(Keys(bestFirst.rules), Keys(depthFirst.rules));
+  }
+}
+
+TEST(SimpleExpressionParser, StateBudget) {
+  AntlrPipeline<ExprGrammar> pipeline("var c = a + b");
+  pipeline.tokens.fill();
+
+  c3::CodeCompletionCore completion(&pipeline.parser);
+  const auto full = completion.collectCandidates(6);  // NOLINT: magic
+  EXPECT_FALSE(full.isCancelled);
+  const std::size_t required = completion.statistics().statesProcessed;
+
+  EXPECT_EQ(completion.collectCandidates(6, {.maxStates = required}), full);  // NOLINT: magic
+
+  for (const auto order : {c3::ExplorationOrder::DepthFirst, c3::ExplorationOrder::BestFirst}) {
+    const c3::Parameters parameters = {.order = order, .maxStates = required / 2};
+    const auto partial = completion.collectCandidates(6, parameters);  // NOLINT: magic
+    EXPECT_TRUE(partial.isCancelled);
+    EXPECT_LE(completion.statistics().statesProcessed, required / 2);
+
+    // A state budget is deterministic, unlike a timeout.
+    EXPECT_EQ(completion.collectCandidates(6, parameters), partial);  // NOLINT: magic
+  }
+}
+
+TEST(SimpleExpressionParser, GrammarAnalysisTables) {
+  AntlrPipeline<ExprGrammar> pipeline("");
+  const auto& atn = pipeline.parser.getATN();
+  const auto shared = c3::GrammarAnalysis::forATN(atn);
+  const auto& analysis = *shared;
+
+  // Models of the grammar share the analysis and count it in their size.
+  EXPECT_EQ(shared, c3::GrammarAnalysis::forATN(atn));
+  const c3::GrammarModel model(pipeline.parser);
+  EXPECT_EQ(&model.analysis(), &analysis);
+  EXPECT_GT(model.bytes(), analysis.bytes());
+
+  const auto expressionStart = atn.ruleToStartState[ExprParser::RuleExpression]->stateNumber;
+  EXPECT_THAT(
+      analysis.firstSet(expressionStart).toList(),
+      UnorderedElementsAre(ExprLexer::VAR, ExprLexer::LET, ExprLexer::ID)
+  );
+  EXPECT_FALSE(analysis.reachesRuleEnd(expressionStart));
+  EXPECT_TRUE(analysis.canContinue(expressionStart, ExprLexer::ID));
+  EXPECT_FALSE(analysis.canContinue(expressionStart, ExprLexer::PLUS));
+
+  // The fixed token sequence after 'var' or 'let'.
+  const auto* assignment = atn.ruleToStartState[ExprParser::RuleAssignment];
+  const auto* keyword = assignment->transitions[0]->target;
+  ASSERT_FALSE(keyword->transitions.empty());
+  EXPECT_THAT(
+      analysis.followingTokens(keyword->transitions[0]->target->stateNumber),
+      ElementsAre(ExprLexer::ID, ExprLexer::EQUAL)
+  );
+
+  EXPECT_TRUE(analysis.isRecursive(ExprParser::RuleSimpleExpression));
+  EXPECT_FALSE(analysis.isRecursive(ExprParser::RuleExpression));
+  EXPECT_FALSE(analysis.isRecursive(ExprParser::RuleIdentifier));
+  EXPECT_THAT(
+      analysis.ruleLevels(),
+      ElementsAre(
+          ElementsAre(ExprParser::RuleIdentifier),
+          ElementsAre(ExprParser::RuleVariableRef, ExprParser::RuleFunctionRef),
+          ElementsAre(ExprParser::RuleSimpleExpression),
+          ElementsAre(ExprParser::RuleAssignment),
+          ElementsAre(ExprParser::RuleExpression)
+      )
+  );
+}
+
+TEST(SimpleExpressionParser, StateMerging) {
+  // 'b + c' is both the right operand of '*' and, after 'a * b', the right
+  // operand of '+'. Both ways end after 'c' in the same loop state.
+  AntlrPipeline<ExprGrammar> pipeline("a * b + c");
+  pipeline.tokens.fill();
+
+  c3::CodeCompletionCore completion(&pipeline.parser);
+  const auto merged = completion.collectCandidates(9);  // NOLINT: magic
+  const c3::Statistics mergedStats = completion.statistics();
+  EXPECT_GT(mergedStats.statesMerged, 0);
+  EXPECT_THAT(
+      Keys(merged.tokens),
+      UnorderedElementsAre(
+          ExprLexer::PLUS,
+          ExprLexer::MINUS,
+          ExprLexer::MULTIPLY,
+          ExprLexer::DIVIDE,
+          ExprLexer::OPEN_PAR
+      )
+  );
+
+  completion.debugOptions.disableStateMerging = true;
+  const auto plain = completion.collectCandidates(9);  // NOLINT: magic
+  EXPECT_EQ(completion.statistics().statesMerged, 0);
+  EXPECT_GT(completion.statistics().statesProcessed, mergedStats.statesProcessed);
+  EXPECT_EQ(plain, merged);
+}
+
+TEST(SimpleExpressionParser, BuildFollowSets) {
+  AntlrPipeline<ExprGrammar> pipeline("var c = a + b");
+  pipeline.tokens.fill();
+  const auto& atn = pipeline.parser.getATN();
+
+  // Follow sets determined lazily, by completing at every position.
+  auto lazy = std::make_shared<const c3::GrammarModel>(pipeline.parser);
+  c3::CodeCompletionCore lazyCompletion(lazy, &pipeline.parser);
+  std::vector<c3::CandidatesCollection> expected;
+  for (std::size_t k = 0; k <= 10; ++k) {  // NOLINT: magic
+    expected.push_back(lazyCompletion.collectCandidates(k));
+  }
+
+  auto sequential = std::make_shared<const c3::GrammarModel>(pipeline.parser);
+  c3::CodeCompletionCore(sequential, &pipeline.parser).buildFollowSets(1);
+
+  auto parallel = std::make_shared<const c3::GrammarModel>(pipeline.parser);
+  c3::CodeCompletionCore completion(parallel, &pipeline.parser);
+  completion.buildFollowSets(4);  // NOLINT: magic
+  EXPECT_EQ(completion.statistics().followSetsComputed, atn.ruleToStartState.size());
+  EXPECT_EQ(parallel->followSets().size(), atn.ruleToStartState.size());
+
+  const auto any = [](const c3::FollowSetsHolder& /*holder*/) { return true; };
+  for (const auto* start : atn.ruleToStartState) {
+    const auto built = parallel->followSets().find(start->stateNumber, any);
+    ASSERT_NE(built, nullptr);
+    EXPECT_EQ(*built, *sequential->followSets().find(start->stateNumber, any));
+
+    if (const auto determined = lazy->followSets().find(start->stateNumber, any)) {
+      EXPECT_EQ(*built, *determined);
+    }
+  }
+
+  for (std::size_t k = 0; k <= 10; ++k) {  // NOLINT: magic
+    EXPECT_EQ(completion.collectCandidates(k), expected[k]);
+    EXPECT_EQ(completion.statistics().followSetsComputed, 0);
+  }
+}
+
+TEST(SimpleExpressionParser, GeneratedFollowSets) {
+  AntlrPipeline<ExprGrammar> pipeline("var c = a + b");
+  pipeline.tokens.fill();
+  const auto& atn = pipeline.parser.getATN();
+  const c3::FollowSetsTables& tables = c3::tables::ExprFollowSets;
+
+  EXPECT_THAT(
+      std::vector(tables.preferredRules.begin(), tables.preferredRules.end()),
+      ElementsAre(ExprParser::RuleFunctionRef, ExprParser::RuleVariableRef)
+  );
+
+  auto lazy = std::make_shared<const c3::GrammarModel>(pipeline.parser);
+  c3::CodeCompletionCore lazyCompletion(lazy, &pipeline.parser);
+  lazyCompletion.preferredRules = {ExprParser::RuleFunctionRef, ExprParser::RuleVariableRef};
+
+  auto model = std::make_shared<const c3::GrammarModel>(pipeline.parser);
+  c3::CodeCompletionCore completion(model, &pipeline.parser);
+  EXPECT_TRUE(completion.loadFollowSets(tables));
+  EXPECT_EQ(model->followSets().size(), atn.ruleToStartState.size());
+  EXPECT_EQ(completion.preferredRules, lazyCompletion.preferredRules);
+
+  for (std::size_t k = 0; k <= 10; ++k) {  // NOLINT: magic
+    EXPECT_EQ(completion.collectCandidates(k), lazyCompletion.collectCandidates(k));
+    EXPECT_EQ(completion.statistics().followSetsComputed, 0);
+  }
+
+  // Tables of another grammar (or version of it) are rejected.
+  c3::FollowSetsTables mismatch = tables;
+  mismatch.stateCount += 1;
+  auto other = std::make_shared<const c3::GrammarModel>(pipeline.parser);
+  EXPECT_FALSE(c3::CodeCompletionCore(other, &pipeline.parser).loadFollowSets(mismatch));
+  EXPECT_EQ(other->followSets().size(), 0);
+
+  // Unknown preferred rules fail the generation instead of being dropped.
+  std::ostringstream header;
+  std::ostringstream source;
+  EXPECT_FALSE(c3::writeFollowSetsTables(
+      pipeline.parser, "Tables", {"functionRef", "functionCall"}, header, source
+  ));
+  EXPECT_TRUE(header.str().empty());
+  EXPECT_TRUE(source.str().empty());
+}
+
+TEST(SimpleExpressionParser, OperatorTable) {
+  AntlrPipeline<ExprGrammar> pipeline("");
+  const auto& atn = pipeline.parser.getATN();
+  const auto analysis = c3::GrammarAnalysis::forATN(atn);
+
+  std::vector<const c3::OperatorTable*> tables;
+  for (const auto* state : atn.states) {
+    if (state != nullptr && analysis->operatorTable(state->stateNumber) != nullptr) {
+      EXPECT_EQ(state->ruleIndex, ExprParser::RuleSimpleExpression);
+      tables.push_back(analysis->operatorTable(state->stateNumber));
+    }
+  }
+  ASSERT_EQ(tables.size(), 1);
+
+  const auto& plus = tables[0]->alternatives(ExprLexer::PLUS);
+  const auto& minus = tables[0]->alternatives(ExprLexer::MINUS);
+  const auto& multiply = tables[0]->alternatives(ExprLexer::MULTIPLY);
+  ASSERT_EQ(plus.size(), 1);
+  ASSERT_EQ(minus.size(), 1);
+  ASSERT_EQ(multiply.size(), 1);
+  EXPECT_EQ(plus[0].precedence, minus[0].precedence);
+  EXPECT_NE(plus[0].precedence, multiply[0].precedence);
+  EXPECT_TRUE(tables[0]->alternatives(ExprLexer::ID).empty());
+}
+
+TEST(SimpleExpressionParser, OperatorTableWork) {
+  // Each operator is matched against both operator alternatives without the
+  // table, and only against its own with it.
+  AntlrPipeline<ExprGrammar> pipeline("a + b * c - d / e +");
+  pipeline.tokens.fill();
+
+  c3::CodeCompletionCore completion(&pipeline.parser);
+  const auto table = completion.collectCandidates(19);  // NOLINT: magic
+  const c3::Statistics tableStats = completion.statistics();
+
+  completion.debugOptions.disableOperatorTables = true;
+  const auto plain = completion.collectCandidates(19);  // NOLINT: magic
+  EXPECT_GT(completion.statistics().statesProcessed, tableStats.statesProcessed);
+  EXPECT_EQ(plain, table);
+}
+
+TEST(SimpleExpressionParser, ProcessMetrics) {
+  AntlrPipeline<ExprGrammar> pipeline("var c = a + b");
+  pipeline.tokens.fill();
+
+  const std::string grammar = pipeline.parser.getGrammarFileName();
+  auto& registry = c3::MetricsRegistry::instance();
+  const auto before = registry.snapshot().grammars[grammar];
+
+  // A cold cache, so follow sets are determined, also for spliced rules.
+  auto model = std::make_shared<const c3::GrammarModel>(pipeline.parser);
+  c3::CodeCompletionCore completion(model, &pipeline.parser);
+  std::uint64_t statesProcessed = 0;
+  std::uint64_t lookups = 0;
+  std::uint64_t computed = 0;
+  for (std::size_t caret = 0; caret < 8; ++caret) {  // NOLINT: magic
+    completion.collectCandidates(caret);
+    statesProcessed += completion.statistics().statesProcessed;
+    lookups += completion.statistics().followSetsLookups;
+    computed += completion.statistics().followSetsComputed;
+  }
+
+  std::atomic<bool> cancelled = true;
+  EXPECT_TRUE(completion.collectCandidates(6, {.isCancelled = &cancelled}).isCancelled);
+  statesProcessed += completion.statistics().statesProcessed;
+  lookups += completion.statistics().followSetsLookups;
+  computed += completion.statistics().followSetsComputed;
+
+  // Disabled recording must not count.
+  registry.setEnabled(false);
+  completion.collectCandidates(6);  // NOLINT: magic
+  registry.setEnabled(true);
+
+  // Viability checks are no completion requests.
+  EXPECT_TRUE(completion.isViablePrefix(6));  // NOLINT: magic
+
+  const auto after = registry.snapshot().grammars[grammar];
+  EXPECT_EQ(after.requests - before.requests, 9);
+  EXPECT_EQ(after.cancellations - before.cancellations, 1);
+  EXPECT_EQ(after.timeouts - before.timeouts, 0);
+  EXPECT_EQ(after.statesProcessed - before.statesProcessed, statesProcessed);
+  EXPECT_EQ(after.latency.count - before.latency.count, 9);
+  EXPECT_EQ(after.statesPerRequest.sum - before.statesPerRequest.sum, statesProcessed);
+  EXPECT_EQ(after.followSetsLookups - before.followSetsLookups, lookups);
+  EXPECT_EQ(after.followSetsComputed - before.followSetsComputed, computed);
+  EXPECT_GT(computed, 0);
+  EXPECT_GE(lookups, computed);
+}
+
+TEST(SimpleExpressionParser, GrammarRegistry) {
+  AntlrPipeline<ExprGrammar> pipeline("var c = a + b");
+  pipeline.tokens.fill();
+
+  std::size_t loads = 0;
+  const auto loader = [&](c3::CompletionOptions options) {
+    return [&, options] {
+      ++loads;
+      return std::make_shared<const c3::GrammarModel>(
+          pipeline.parser.getATN(),
+          pipeline.parser.getVocabulary(),
+          pipeline.parser.getRuleNames(),
+          "Expr",
+          options
+      );
+    };
+  };
+
+  c3::CompletionOptions preferred;
+  preferred.preferredRules = {ExprParser::RuleVariableRef};
+
+  // Too small for more than one grammar at a time.
+  c3::GrammarRegistry registry(1);
+  registry.add("plain", loader({}));
+  registry.add("preferred", loader(preferred));
+  EXPECT_THAT(registry.names(), testing::ElementsAre("plain", "preferred"));
+  EXPECT_EQ(registry.model("unknown"), nullptr);
+  EXPECT_EQ(loads, 0);
+
+  const auto plain = registry.model("plain");
+  EXPECT_EQ(registry.model("plain"), plain);
+  EXPECT_EQ(loads, 1);
+
+  c3::CodeCompletionCore completion(registry.model("preferred"), &pipeline.parser);
+  const auto candidates = completion.collectCandidates(10);  // NOLINT: magic
+  EXPECT_THAT(Keys(candidates.rules), testing::UnorderedElementsAre(ExprParser::RuleVariableRef));
+  EXPECT_EQ(loads, 2);
+  EXPECT_FALSE(registry.isLoaded("plain"));
+  EXPECT_TRUE(registry.isLoaded("preferred"));
+  EXPECT_EQ(registry.evictions(), 1);
+
+  // An unloaded grammar is loaded again on its next use.
+  EXPECT_NE(registry.model("plain"), nullptr);
+  EXPECT_EQ(loads, 3);
+  EXPECT_FALSE(registry.isLoaded("preferred"));
+  EXPECT_GT(registry.bytes(), 0);
+}
+
+TEST(SimpleExpressionParser, BatchCompletion) {
+  const std::size_t maxTokenIndex = 8;
+
+  AntlrPipeline<ExprGrammar> first("var c = a + b");
+  first.tokens.fill();
+  AntlrPipeline<ExprGrammar> second("let x = y * z");
+  second.tokens.fill();
+
+  auto model = std::make_shared<const c3::GrammarModel>(first.parser);
+
+  std::vector<c3::CompletionRequest> requests;
+  std::vector<c3::CandidatesCollection> expected;
+  c3::CodeCompletionCore sequential(model);
+  for (auto* stream : {&first.tokens, &second.tokens}) {
+    for (std::size_t k = 0; k <= maxTokenIndex; ++k) {
+      requests.push_back({.tokenStream = stream, .caretTokenIndex = k});
+      expected.push_back(sequential.collectCandidates(*stream, k));
+    }
+  }
+  requests.push_back({.tokenTypes = {ExprLexer::VAR, ExprLexer::ID, ExprLexer::EQUAL}});
+  expected.push_back(sequential.collectCandidates(requests.back().tokenTypes));
+
+  c3::BatchCompletion batch(model, 4);  // NOLINT: magic
+  for (std::size_t round = 0; round < 2; ++round) {
+    const auto result = batch.run(requests);
+    EXPECT_EQ(result.results, expected);
+    EXPECT_EQ(result.statistics.requests, requests.size());
+    EXPECT_EQ(result.statistics.cancelled, 0);
+    EXPECT_EQ(result.statistics.threads, 4);
+    EXPECT_GT(result.statistics.totals.statesProcessed, 0);
+  }
+
+  EXPECT_TRUE(batch.run({}).results.empty());
+
+  // A failing request is reported on the calling thread, and the workers stay
+  // usable.
+  AntlrPipeline<ExprGrammar> unfilled("var a");
+  std::vector<c3::CompletionRequest> failing = requests;
+  failing.push_back({.tokenStream = &unfilled.tokens, .caretTokenIndex = 1});
+  EXPECT_ANY_THROW(batch.run(failing));
+  EXPECT_EQ(batch.run(requests).results, expected);
+
+  // Concurrent requests cannot update the same checkpoints.
+  c3::Checkpoints checkpoints;
+  std::vector<c3::CompletionRequest> sharing = requests;
+  sharing[0].parameters.checkpoints = &checkpoints;
+  sharing[1].parameters.checkpoints = &checkpoints;
+  EXPECT_THROW(batch.run(sharing), std::invalid_argument);
+  EXPECT_EQ(checkpoints.size(), 0);
+}
+
 TEST(SimpleExpressionParser, ConcurrencySmoke) {
   const std::size_t concurrency = 8;
   const std::size_t rounds = 32;
@@ -243,4 +941,218 @@ TEST(SimpleExpressionParser, ConcurrencySmoke) {
   }
 }
 
+TEST(SimpleExpressionParser, SharedGrammarModel) {
+  const std::size_t concurrency = 8;
+  const std::size_t maxTokenIndex = 8;
+
+  AntlrPipeline<ExprGrammar> pipeline("var c = a + b");
+  pipeline.tokens.fill();
+
+  c3::CompletionOptions options;
+  options.preferredRules = {ExprParser::RuleFunctionRef, ExprParser::RuleVariableRef};
+  options.ignoredTokens = {ExprParser::VAR, ExprParser::LET};
+
+  auto reference = std::make_shared<const c3::GrammarModel>(pipeline.parser, options);
+  c3::CodeCompletionCore sequential(reference, &pipeline.parser);
+  EXPECT_EQ(sequential.preferredRules, options.preferredRules);
+
+  std::vector<c3::CandidatesCollection> expected;
+  for (std::size_t k = 0; k <= maxTokenIndex; ++k) {
+    expected.push_back(sequential.collectCandidates(k));
+  }
+
+  // One model for all threads, one context per thread, reused for all requests.
+  auto model = std::make_shared<const c3::GrammarModel>(pipeline.parser, options);
+  {
+    std::vector<std::jthread> threads;
+    for (std::size_t i = 0; i < concurrency; ++i) {
+      threads.emplace_back([&] {
+        AntlrPipeline<ExprGrammar> local("var c = a + b");
+        local.tokens.fill();
+
+        c3::CodeCompletionCore completion(model, &local.parser);
+        for (std::size_t k = 0; k <= maxTokenIndex; ++k) {
+          EXPECT_EQ(completion.collectCandidates(k), expected[k]);
+        }
+      });
+    }
+  }
+
+  // Follow sets computed concurrently for the same rule are stored only once.
+  EXPECT_EQ(model->followSets().size(), reference->followSets().size());
+}
+
+TEST(SimpleExpressionParser, GrammarSpecializedCore) {
+  using Completion = c3::GrammarCompletionCore<ExprParser>;
+
+  AntlrPipeline<ExprGrammar> pipeline("var c = a + b");
+  pipeline.tokens.fill();
+
+  auto model = std::make_shared<const c3::GrammarModel>(pipeline.parser);
+  EXPECT_TRUE(Completion::matches(*model));
+
+  c3::CodeCompletionCore generic(model, &pipeline.parser);
+  generic.ignoredTokens = {ExprParser::VAR, ExprParser::LET};
+  generic.preferredRules = {ExprParser::RuleFunctionRef, ExprParser::RuleVariableRef};
+
+  Completion completion(model, &pipeline.parser);
+  completion.ignore<ExprParser::VAR, ExprParser::LET>();
+  completion.prefer<ExprParser::RuleFunctionRef, ExprParser::RuleVariableRef>();
+  EXPECT_EQ(completion.ignoredTokens, generic.ignoredTokens);
+  EXPECT_EQ(completion.preferredRules, generic.preferredRules);
+
+  for (std::size_t k = 0; k <= 10; ++k) {  // NOLINT: magic
+    EXPECT_EQ(completion.collectCandidates(k), generic.collectCandidates(k));
+  }
+
+  // On the whitespace after 'a'.
+  const auto candidates = completion.collectCandidates(7);  // NOLINT: magic
+  const Completion::TokenSet tokens = Completion::tokenSet(candidates);
+  EXPECT_EQ(tokens.count(), candidates.tokens.size());
+  EXPECT_TRUE(tokens.test(ExprParser::PLUS));
+  EXPECT_FALSE(tokens.test(ExprParser::OPEN_PAR));
+  const Completion::RuleSet rules = Completion::ruleSet(candidates);
+  EXPECT_TRUE(rules.test(ExprParser::RuleFunctionRef));
+  EXPECT_FALSE(rules.test(ExprParser::RuleVariableRef));
+
+  Completion::TokenSet ignored;
+  ignored.set(ExprParser::PLUS).set(ExprParser::MINUS);
+  completion.ignore(ignored);
+  EXPECT_THAT(
+      Keys(completion.collectCandidates(7).tokens),  // NOLINT: magic
+      UnorderedElementsAre(ExprParser::MULTIPLY, ExprParser::DIVIDE)
+  );
+}
+
+TEST(SimpleExpressionParser, ParseTreeFastForward) {
+  for (const auto* text : {"var c = a + b()", "var c = a + + b"}) {
+    AntlrPipeline<ExprGrammar> pipeline(text);
+    auto* tree = pipeline.parser.expression();
+
+    c3::CodeCompletionCore walked(&pipeline.parser);
+    c3::CodeCompletionCore completion(&pipeline.parser);
+    std::size_t skipped = 0;
+    for (std::size_t k = 0; k < pipeline.tokens.size(); ++k) {
+      const auto expected = walked.collectCandidates(k);
+      EXPECT_EQ(completion.collectCandidates(k, {.parseTree = tree}), expected);
+      EXPECT_LE(completion.statistics().statesProcessed, walked.statistics().statesProcessed);
+      skipped += completion.statistics().rulesSkipped;
+    }
+    EXPECT_GT(skipped, 0);
+
+    // At the start nothing precedes the caret, so there is nothing to skip.
+    completion.collectCandidates(0, {.parseTree = tree});
+    EXPECT_EQ(completion.statistics().rulesSkipped, 0);
+  }
+}
+
+TEST(SimpleExpressionParser, Checkpoints) {
+  AntlrPipeline<ExprGrammar> pipeline("var c = a + b * c - d / e + f() * g - h");
+  pipeline.tokens.fill();
+  const std::size_t last = pipeline.tokens.size() - 1;
+
+  c3::CodeCompletionCore walked(&pipeline.parser);
+  walked.preferredRules = {ExprParser::RuleFunctionRef, ExprParser::RuleVariableRef};
+  c3::CodeCompletionCore completion(&pipeline.parser);
+  completion.preferredRules = walked.preferredRules;
+
+  c3::CheckpointOptions options;
+  options.interval = 4;  // NOLINT: magic
+  options.syncTokens = {ExprParser::EQUAL};
+  c3::Checkpoints checkpoints(options);
+
+  // Completing at the end records checkpoints for the whole input.
+  EXPECT_EQ(
+      completion.collectCandidates(last, {.checkpoints = &checkpoints}),
+      walked.collectCandidates(last)
+  );
+  EXPECT_GT(completion.statistics().tokensSimulated, 0);
+  EXPECT_GT(checkpoints.size(), 2);
+  EXPECT_GT(checkpoints.bytes(), 0);
+
+  const std::vector<std::size_t> recorded = checkpoints.tokenIndexes();
+  EXPECT_TRUE(std::ranges::is_sorted(recorded));
+  EXPECT_EQ(recorded.front(), 0);
+
+  // Later requests only simulate the tokens after the last checkpoint.
+  for (std::size_t k = 0; k <= last; ++k) {
+    EXPECT_EQ(
+        completion.collectCandidates(k, {.checkpoints = &checkpoints}),
+        walked.collectCandidates(k)
+    );
+    EXPECT_LT(completion.statistics().tokensSimulated, options.interval);
+  }
+  EXPECT_EQ(checkpoints.tokenIndexes(), recorded);
+
+  // An edit drops the checkpoints after it, which are recorded again later.
+  const std::size_t edit = 12;  // NOLINT: magic
+  checkpoints.invalidate(edit);
+  EXPECT_TRUE(std::ranges::all_of(checkpoints.tokenIndexes(), [&](std::size_t index) {
+    return index <= edit;
+  }));
+  EXPECT_LT(checkpoints.size(), recorded.size());
+
+  EXPECT_EQ(
+      completion.collectCandidates(last, {.checkpoints = &checkpoints}),
+      walked.collectCandidates(last)
+  );
+  EXPECT_EQ(checkpoints.tokenIndexes(), recorded);
+
+  // Simulation ends at a syntax error, completion still works before it.
+  AntlrPipeline<ExprGrammar> invalid("var c = a + + b - c");
+  invalid.tokens.fill();
+  c3::CodeCompletionCore invalidWalked(&invalid.parser);
+  c3::CodeCompletionCore invalidCompletion(&invalid.parser);
+  c3::Checkpoints invalidCheckpoints(options);
+  for (std::size_t k = invalid.tokens.size(); k-- > 0;) {
+    EXPECT_EQ(
+        invalidCompletion.collectCandidates(k, {.checkpoints = &invalidCheckpoints}),
+        invalidWalked.collectCandidates(k)
+    );
+  }
+}
+
+TEST(SimpleExpressionParser, ViablePrefix) {
+  AntlrPipeline<ExprGrammar> pipeline("var c = a + + b");
+  pipeline.tokens.fill();
+  const std::size_t secondPlus = 10;  // NOLINT: magic
+  const std::size_t last = pipeline.tokens.size() - 1;
+
+  c3::CodeCompletionCore completion(&pipeline.parser);
+  c3::CodeCompletionCore collecting(&pipeline.parser);
+
+  EXPECT_TRUE(completion.isViablePrefix(secondPlus));
+  EXPECT_EQ(completion.furthestViableToken(), secondPlus);
+
+  const auto expected = collecting.collectCandidates(secondPlus);
+  EXPECT_LE(completion.statistics().statesProcessed, collecting.statistics().statesProcessed);
+
+  EXPECT_FALSE(completion.isViablePrefix(last));
+  EXPECT_EQ(completion.furthestViableToken(), secondPlus);
+
+  // A check leaves nothing behind which affects completion.
+  EXPECT_EQ(completion.collectCandidates(secondPlus), expected);
+
+  EXPECT_TRUE(completion.isViablePrefix(std::vector<std::size_t>{}));
+  EXPECT_TRUE(completion.isViablePrefix(std::vector<std::size_t>{
+      ExprParser::VAR, ExprParser::ID, ExprParser::EQUAL, ExprParser::ID, ExprParser::OPEN_PAR
+  }));
+  EXPECT_FALSE(completion.isViablePrefix(std::vector<std::size_t>{
+      ExprParser::VAR, ExprParser::EQUAL, ExprParser::ID
+  }));
+  EXPECT_EQ(completion.furthestViableToken(), 1);
+
+  // The same verdict as the parser's for complete inputs.
+  const std::vector<std::size_t> valid = {ExprParser::ID, ExprParser::PLUS, ExprParser::ID};
+  EXPECT_EQ(CountParseErrors(valid), 0);
+  EXPECT_TRUE(completion.isViablePrefix(valid));
+
+  const std::vector<std::size_t> invalid = {
+      ExprParser::ID, ExprParser::OPEN_PAR, ExprParser::CLOSE_PAR, ExprParser::CLOSE_PAR
+  };
+  EXPECT_GT(CountParseErrors(invalid), 0);
+  EXPECT_FALSE(completion.isViablePrefix(invalid));
+  EXPECT_EQ(completion.furthestViableToken(), 3);
+}
+
 }  // namespace c3::test
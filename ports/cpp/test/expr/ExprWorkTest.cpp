@@ -0,0 +1,49 @@
+#include <ExprLexer.h>
+#include <ExprParser.h>
+#include <gtest/gtest.h>
+
+#include <utility/WorkCounters.hpp>
+
+namespace c3::test {
+
+namespace {
+
+struct ExprGrammar {
+  using Lexer = ExprLexer;
+  using Parser = ExprParser;
+};
+
+// The limits leave generous headroom over the current counts. They are meant
+// to catch algorithmic regressions (lost memoization, exponential walks), not
+// small fluctuations.
+constexpr WorkLimits Limits = {
+    .statesProcessed = 2'000,
+    .ruleInvocations = 500,
+    .followSetsStates = 2'000,
+    .allocations = 5'000,
+};
+
+const antlr4::ParserRuleContext* Parse(ExprParser& parser) {
+  parser.expression();
+  return nullptr;
+}
+
+}  // namespace
+
+TEST(ExprWorkCounters, InputStart) {
+  ExpectWorkWithinLimits<ExprGrammar>({"var c = a + b()", 0, Limits}, Parse);
+}
+
+TEST(ExprWorkCounters, VariableReference) {
+  ExpectWorkWithinLimits<ExprGrammar>({"var c = a + b()", 6, Limits}, Parse);  // NOLINT: magic
+}
+
+TEST(ExprWorkCounters, Operator) {
+  ExpectWorkWithinLimits<ExprGrammar>({"var c = a + b()", 8, Limits}, Parse);  // NOLINT: magic
+}
+
+TEST(ExprWorkCounters, InputEnd) {
+  ExpectWorkWithinLimits<ExprGrammar>({"var c = a + b()", 13, Limits}, Parse);  // NOLINT: magic
+}
+
+}  // namespace c3::test
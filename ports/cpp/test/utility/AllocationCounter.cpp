@@ -0,0 +1,48 @@
+#include "AllocationCounter.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<std::size_t> allocationCount = 0;  // NOLINT: global
+
+}  // namespace
+
+namespace c3::test {
+
+std::size_t AllocationCount() {
+  return allocationCount.load(std::memory_order_relaxed);
+}
+
+}  // namespace c3::test
+
+void* operator new(std::size_t size) {
+  allocationCount.fetch_add(1, std::memory_order_relaxed);
+  if (void* pointer = std::malloc(size == 0 ? 1 : size)) {  // NOLINT: manual memory
+    return pointer;
+  }
+  throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+  return ::operator new(size);
+}
+
+void operator delete(void* pointer) noexcept {
+  std::free(pointer);  // NOLINT: manual memory
+}
+
+void operator delete[](void* pointer) noexcept {
+  std::free(pointer);  // NOLINT: manual memory
+}
+
+void operator delete(void* pointer, std::size_t /*size*/) noexcept {
+  std::free(pointer);  // NOLINT: manual memory
+}
+
+void operator delete[](void* pointer, std::size_t /*size*/) noexcept {
+  std::free(pointer);  // NOLINT: manual memory
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+
+namespace c3::test {
+
+/**
+ * Returns the number of global `operator new` calls made by the test
+ * executable so far. Counting is done by the replacement allocation functions
+ * in `AllocationCounter.cpp`.
+ */
+std::size_t AllocationCount();
+
+}  // namespace c3::test
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <antlr4-c3/CodeCompletionCore.hpp>
+#include <antlr4-c3/GrammarModel.hpp>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility/AllocationCounter.hpp>
+#include <utility/AntlrPipeline.hpp>
+
+namespace c3::test {
+
+/**
+ * Upper bounds for the deterministic work counters of a single
+ * `collectCandidates` call.
+ */
+struct WorkLimits {
+  std::size_t statesProcessed;
+  std::size_t ruleInvocations;
+  std::size_t followSetsStates;
+  std::size_t allocations;
+};
+
+struct WorkCase {
+  std::string_view source;
+  std::size_t caretTokenIndex;
+  WorkLimits limits;
+};
+
+/**
+ * Runs a completion request on a model of its own, so that it starts with an
+ * empty follow sets cache, and checks its work counters against the given
+ * limits. The follow sets work is taken from the first (cold) call, all other
+ * counters from a second (warm) call, which no longer computes follow sets.
+ * The measured counters are recorded as test properties (see the XML output
+ * of `--gtest_output`), to derive the limits from.
+ *
+ * @param workCase The input, caret and limits.
+ * @param parse Invoked with the parser to run the start rule. Returns the
+ * context to pass to `collectCandidates` or `nullptr`.
+ */
+template <class Grammar, class Parse>
+void ExpectWorkWithinLimits(const WorkCase& workCase, Parse parse) {
+  AntlrPipeline<Grammar> pipeline(workCase.source);
+  const antlr4::ParserRuleContext* context = parse(pipeline.parser);
+
+  auto model = std::make_shared<const GrammarModel>(pipeline.parser);
+  CodeCompletionCore completion(model, &pipeline.parser);
+  completion.collectCandidates(workCase.caretTokenIndex, {.context = context});
+  const Statistics cold = completion.statistics();
+
+  const std::size_t allocationsBefore = AllocationCount();
+  completion.collectCandidates(workCase.caretTokenIndex, {.context = context});
+  const std::size_t allocations = AllocationCount() - allocationsBefore;
+  const Statistics warm = completion.statistics();
+
+  ::testing::Test::RecordProperty("statesProcessed", std::to_string(warm.statesProcessed));
+  ::testing::Test::RecordProperty("ruleInvocations", std::to_string(warm.ruleInvocations));
+  ::testing::Test::RecordProperty("followSetsStates", std::to_string(cold.followSetsStates));
+  ::testing::Test::RecordProperty("allocations", std::to_string(allocations));
+
+  EXPECT_GT(cold.followSetsComputed, 0);
+  EXPECT_LE(cold.followSetsStates, workCase.limits.followSetsStates);
+
+  EXPECT_EQ(warm.followSetsComputed, 0);
+  EXPECT_EQ(warm.statesProcessed, cold.statesProcessed);
+  EXPECT_LE(warm.statesProcessed, workCase.limits.statesProcessed);
+  EXPECT_LE(warm.ruleInvocations, workCase.limits.ruleInvocations);
+  EXPECT_LE(allocations, workCase.limits.allocations);
+}
+
+}  // namespace c3::test
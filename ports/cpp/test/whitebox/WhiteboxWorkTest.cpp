@@ -0,0 +1,46 @@
+#include <WhiteboxLexer.h>
+#include <WhiteboxParser.h>
+#include <gtest/gtest.h>
+
+#include <utility/WorkCounters.hpp>
+
+namespace c3::test {
+
+namespace {
+
+struct WhiteboxGrammar {
+  using Lexer = WhiteboxLexer;
+  using Parser = WhiteboxParser;
+};
+
+// The limits leave generous headroom over the current counts. They are meant
+// to catch algorithmic regressions (lost memoization, exponential walks), not
+// small fluctuations.
+constexpr WorkLimits Limits = {
+    .statesProcessed = 500,
+    .ruleInvocations = 100,
+    .followSetsStates = 500,
+    .allocations = 2'000,
+};
+
+}  // namespace
+
+TEST(WhiteboxWorkCounters, NonExhaustiveFollowSet) {
+  ExpectWorkWithinLimits<WhiteboxGrammar>({"LOREM ", 1, Limits}, [](WhiteboxParser& parser) {
+    return parser.test1();
+  });
+}
+
+TEST(WhiteboxWorkCounters, EmptyFollowSet) {
+  ExpectWorkWithinLimits<WhiteboxGrammar>({"LOREM ", 1, Limits}, [](WhiteboxParser& parser) {
+    return parser.test2();
+  });
+}
+
+TEST(WhiteboxWorkCounters, MultiplePossibleStates) {
+  ExpectWorkWithinLimits<WhiteboxGrammar>({"LOREM IPSUM ", 2, Limits}, [](WhiteboxParser& parser) {
+    return parser.test8();
+  });
+}
+
+}  // namespace c3::test